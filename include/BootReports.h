@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "HIDReportMap.h"
+
+// Report IDs of the synthesized USB descriptor
+#define BOOT_REPORT_KEYBOARD 1
+#define BOOT_REPORT_MOUSE 2
+#define BOOT_REPORT_CONSUMER 3
+
+// Payload sizes, report ID excluded. Keyboard and the first three mouse
+// bytes use the boot protocol layouts.
+#define BOOT_KEYBOARD_LENGTH 8
+#define BOOT_MOUSE_LENGTH 5
+#define BOOT_CONSUMER_LENGTH 2
+
+// Field roles resolved per peer
+#define BOOT_MAX_FIELDS 32
+
+// Fixed keyboard + mouse + consumer descriptor served instead of the
+// mirrored peer report maps
+extern const uint8_t bootReportDescriptor[];
+extern const size_t bootReportDescriptorSize;
+
+// Translates a peer's input reports into the synthesized descriptor.
+// compile() runs at connect time and resolves which fields of which report
+// feed the keyboard, mouse or consumer report; translate() then only reads
+// those fields. NKRO key bitmaps are folded into six key slots, with
+// ErrorRollOver reported when more keys are down. Deltas wider than the boot
+// report's 8 bits are clamped and the remainder is carried into the peer's
+// next mouse report, so fast motion is delayed, never lost.
+//
+// All peers share the synthesized report IDs, so each translator keeps what
+// its peer holds (modifiers, keys, buttons, consumer usage) and mergeHeld()
+// folds that into another peer's translated report. The host then sees the
+// union, and one peer's report never releases what another still holds.
+class BootTranslator
+{
+public:
+  BootTranslator() { clear(); }
+
+  void clear();
+  void compile(const HIDReportMap &map);
+
+  // Synthesized report ID a peer report is translated into, 0 if none
+  uint8_t targetId(uint8_t reportId) const { return _route[reportId] ? _routes[_route[reportId] - 1].target : 0; }
+
+  // Writes the translated payload to out (at least BOOT_KEYBOARD_LENGTH
+  // bytes) and returns its length, 0 if the report has no translation.
+  // NimBLE host task only.
+  size_t translate(uint8_t reportId, const uint8_t *data, size_t length, uint8_t *out);
+
+  // Adds what this peer holds to a translated report for target: modifiers
+  // and buttons are OR'd, keys join the free slots (ErrorRollOver once they
+  // run out). Deltas are left alone; this peer's were sent with its own
+  // reports. NimBLE host task only.
+  void mergeHeld(uint8_t target, uint8_t *out);
+
+  // Forgets what the peer holds, once it is gone. Any task: the host task
+  // applies it before it next reads the held state.
+  void releaseHeld() { _releasePending.store(true, std::memory_order_release); }
+
+private:
+  enum Role : uint8_t
+  {
+    ROLE_KEYS,    // keyboard usages, array or bitmap
+    ROLE_BUTTONS, // button bitmap
+    ROLE_X,
+    ROLE_Y,
+    ROLE_WHEEL,
+    ROLE_PAN,
+    ROLE_CONSUMER, // consumer usages, array or bitmap
+  };
+
+  struct Source
+  {
+    uint8_t role;
+    uint8_t element; // axis element within the field
+    const HIDField *field;
+  };
+
+  struct Route
+  {
+    uint8_t target;
+    uint8_t first;
+    uint8_t count;
+    uint16_t byteLength; // peer payload length the fields were laid out for
+  };
+
+  void addSource(uint8_t role, uint8_t element, const HIDField *field);
+  void applyRelease();
+  int8_t carryAxis(uint8_t role, int32_t value);
+  void translateKeys(const Source &source, const uint8_t *data, uint8_t *out, uint8_t &keyCount) const;
+  void translateMouse(const Source &source, const uint8_t *data, uint8_t *out);
+  void translateConsumer(const Source &source, const uint8_t *data, uint8_t *out) const;
+
+  uint8_t _route[256]; // index + 1 into _routes, 0 = not translated
+  Route _routes[HID_MAX_REPORTS];
+  uint8_t _routeCount;
+  Source _sources[BOOT_MAX_FIELDS];
+  uint8_t _sourceCount;
+
+  // Last translated state per target, and motion not sent yet per axis
+  // (ROLE_X to ROLE_PAN). NimBLE host task only, see releaseHeld().
+  uint8_t _heldKeyboard[BOOT_KEYBOARD_LENGTH];
+  uint8_t _heldButtons;
+  uint8_t _heldConsumer[BOOT_CONSUMER_LENGTH];
+  int32_t _carry[4];
+  std::atomic<bool> _releasePending{true};
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest report descriptor served over USB
+#define USB_DESCRIPTOR_CAPACITY 1024
+
+// Merges the report maps of several peers into one USB report descriptor.
+// Each peer's report IDs are remapped into a shared ID space; maps without
+// report IDs get one inserted at the start of every top-level collection.
+// Every map is wrapped in Push/Pop, so its global items (Usage Page, Report
+// Size, Report Count, logical range) do not leak into the next one.
+class CompositeDescriptor
+{
+public:
+  void clear()
+  {
+    _size = 0;
+    _nextId = 1;
+  }
+
+  // Appends a peer report map and fills idMap (peer report ID -> USB report
+  // ID, 0 = unmapped). On failure the composite is left unchanged.
+  bool append(const uint8_t *map, size_t len, uint8_t idMap[256]);
+
+  const uint8_t *data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  bool put(const uint8_t *bytes, size_t n);
+  bool allocateId(uint8_t *id);
+
+  uint8_t _data[USB_DESCRIPTOR_CAPACITY];
+  size_t _size = 0;
+  uint16_t _nextId = 1;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+
+class NimBLEClient;
+
+// An idle peer counts as active again after this many reports within the
+// window, whatever its idle interval: a mouse that starts moving sends one
+// report per connection event
+#define CONN_BURST_REPORTS 3
+#define CONN_BURST_WINDOW_MS 200
+
+// Connection parameters in BLE units: intervals 1.25 ms, timeout 10 ms
+struct ConnParams
+{
+  uint16_t minInterval;
+  uint16_t maxInterval;
+  uint16_t latency;
+  uint16_t timeout;
+};
+
+// When to switch a link between its active and idle parameters
+struct ConnProfile
+{
+  const char *name;
+  ConnParams active;
+  ConnParams idle;
+  uint32_t idleAfterMs; // quiet time before the interval is relaxed
+};
+
+enum ConnProfileId : uint8_t
+{
+  CONN_PROFILE_LOW_LATENCY,
+  CONN_PROFILE_BALANCED,
+  CONN_PROFILE_LOW_POWER,
+  CONN_PROFILE_COUNT,
+};
+
+// Renegotiates each link's connection interval from its measured report
+// rate: the fastest interval while reports stream in, a relaxed interval
+// with peripheral latency once the peer goes quiet.
+class ConnTuner
+{
+public:
+  void setProfile(uint8_t id);
+  uint8_t profileId() const { return _profile; }
+  const ConnProfile &profile() const;
+
+  // NimBLE host task, once per report. Returns true when an idle peer just
+  // became active and should be switched back with activate(); if that
+  // cannot be queued, activationDropped() lets the next burst try again.
+  bool onReport(uint8_t peer);
+  void activationDropped(uint8_t peer);
+
+  // loop() side
+  void reset(uint8_t peer);
+  void activate(uint8_t peer, NimBLEClient *client);
+  void update(uint8_t peer, NimBLEClient *client);
+
+  bool isIdle(uint8_t peer) const { return _peers[peer].idle; }
+  uint32_t reportIntervalUs(uint8_t peer) const { return _peers[peer].intervalUs; }
+
+private:
+  struct PeerRate
+  {
+    volatile uint32_t lastReportUs;
+    volatile uint32_t intervalUs; // moving average of the report interval, for display
+    uint32_t burstStartUs;        // first report of the current burst
+    uint8_t burstReports;         // reports since burstStartUs
+    volatile bool idle;
+    volatile bool activating;
+  };
+
+  void apply(uint8_t peer, NimBLEClient *client, const ConnParams &params);
+
+  PeerRate _peers[PROXY_MAX_PEERS] = {};
+  uint8_t _profile = PROXY_CONN_PROFILE;
+};
+
+extern ConnTuner connTuner;
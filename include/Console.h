@@ -0,0 +1,10 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Line-based command console on the CDC serial port. Type "help" for the
+// command list.
+#define CONSOLE_LINE_LENGTH 64
+
+// Reads pending serial input and runs complete commands; call from loop()
+void consolePoll();
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include "ProxyConfig.h"
+
+// Time after a peer is ready before the first informational read, so it
+// never competes with the first reports
+#define INFO_START_DELAY_MS 1000
+
+// Minimum time between two informational reads
+#define INFO_QUERY_SPACING_MS 250
+
+// Battery polling for peers whose Battery Level cannot notify
+#define INFO_BATTERY_POLL_MS 300000
+
+#define INFO_TEXT_LENGTH 32
+#define INFO_BATTERY_UNKNOWN 0xFF
+
+struct DeviceInfo
+{
+  NimBLEAddress identity; // whose info this is
+  char name[INFO_TEXT_LENGTH];
+  char manufacturer[INFO_TEXT_LENGTH];
+  uint16_t vendorId;
+  uint16_t productId;
+  uint16_t productVersion;
+  uint16_t hidVersion; // BCD
+  uint8_t country;
+  uint8_t hidFlags;
+  uint8_t battery; // percent, INFO_BATTERY_UNKNOWN if not read yet
+  uint8_t known;   // bit per InfoQuery already answered
+};
+
+// Informational GATT reads (device name, manufacturer, PnP ID, HID
+// Information, battery level) kept off the connect path. After a peer is
+// ready, poll() issues at most one read per INFO_QUERY_SPACING_MS; results
+// are cached per peer slot and reused when the same identity reconnects,
+// so only the battery is read again. Runs on loop() like every other
+// NimBLEClient call, which keeps it ordered with releaseClient().
+class DeviceInfoPoller
+{
+public:
+  // loop() only
+  void start(uint8_t peer, NimBLEClient *client, const NimBLEAddress &identity, bool batteryNotifies);
+  void stop(uint8_t peer);
+  void poll();
+
+  // Battery notifications from the report path update the cache too
+  void setBattery(uint8_t peer, uint8_t percent);
+
+  const DeviceInfo &info(uint8_t peer) const { return _info[peer]; }
+  void print(Print &out) const;
+
+private:
+  enum InfoQuery : uint8_t
+  {
+    QUERY_BATTERY, // first: the only one shown on the display
+    QUERY_NAME,
+    QUERY_MANUFACTURER,
+    QUERY_PNP_ID,
+    QUERY_HID_INFO,
+    QUERY_COUNT,
+  };
+
+  struct Slot
+  {
+    NimBLEClient *client;
+    uint32_t dueMs;   // next read not before
+    uint8_t pending;  // bit per InfoQuery
+    bool pollBattery; // re-read every INFO_BATTERY_POLL_MS
+    uint32_t batteryDueMs;
+  };
+
+  void query(uint8_t peer, uint8_t which);
+
+  DeviceInfo _info[PROXY_MAX_PEERS] = {};
+  Slot _slots[PROXY_MAX_PEERS] = {};
+  uint32_t _lastQueryMs = 0;
+};
+
+extern DeviceInfoPoller deviceInfo;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ReportRing.h"
+#include "ReportSlot.h"
+#include "PipelineStages.h"
+
+// The portable part of report forwarding: one SPSC ring per peer feeding a
+// ReportCoalescer, and a ReportDedup in front of the endpoint. No RTOS or
+// USB dependencies, so the same code runs in UsbForwarder on the device and
+// in the native replay benchmark. Reports go out through a caller-supplied
+// send(const ReportSlot &) functor; merged(reportId) is told about every
+// report coalesced into another. Exact repeats of the last report sent are
+// not passed to send() at all. Coalescing and dedup are stage types, see
+// PipelineStages.h; by default the ones selected for the build.
+template <size_t PEERS, size_t SLOTS, typename Coalescer = CoalesceStage, typename Dedup = DedupStage>
+class ForwardPipeline
+{
+public:
+  void configure(const HIDReportMap &map)
+  {
+    _coalescer.configure(map);
+    _dedup.configure(map);
+  }
+
+  // Producer side, one task per peer ring
+  ReportSlot *beginReport(uint8_t peer) { return _rings[peer].beginPush(); }
+  void commitReport(uint8_t peer) { _rings[peer].commitPush(); }
+
+  // Consumer side. Moves everything queued in the rings into the coalescer;
+  // a report that cannot be merged first sends what is pending for its ID
+  // (or everything, if the coalescer is out of room). Returns false if the
+  // rings were empty.
+  template <typename Send, typename Merged>
+  bool collect(Send &&send, Merged &&merged)
+  {
+    bool collected = false;
+    for (size_t peer = 0; peer < PEERS; peer++)
+    {
+      ReportSlot *slot;
+      while ((slot = _rings[peer].front()) != nullptr)
+      {
+        CoalesceResult result = _coalescer.add(*slot);
+        if (result == COALESCE_BYPASS)
+          emit(send, *slot);
+        else if (result == COALESCE_MERGED)
+          merged(slot->reportId);
+        else if (result == COALESCE_CONFLICT)
+        {
+          const ReportSlot *pending = _coalescer.findPending(slot->reportId);
+          if (pending)
+          {
+            emit(send, *pending);
+            _coalescer.removePending(slot->reportId);
+          }
+          else
+            sendPending(send);
+          _coalescer.add(*slot);
+        }
+        _rings[peer].pop();
+        collected = true;
+      }
+    }
+    return collected;
+  }
+
+  template <typename Send>
+  bool collect(Send &&send)
+  {
+    return collect(send, [](uint8_t) {});
+  }
+
+  template <typename Send>
+  void sendPending(Send &&send)
+  {
+    for (size_t i = 0; i < _coalescer.pendingCount(); i++)
+      emit(send, _coalescer.pending(i));
+    _coalescer.clearPending();
+  }
+
+  // A send that did not reach the host, or a host that lost its state: the
+  // next report goes out even if it repeats the last one
+  void forgetSent(uint8_t reportId) { _dedup.forget(reportId); }
+  void forgetSent() { _dedup.invalidate(); }
+
+  size_t pendingCount() const { return _coalescer.pendingCount(); }
+  uint32_t mergedCount() const { return _coalescer.mergedCount(); }
+  const Dedup &dedup() const { return _dedup; }
+
+private:
+  template <typename Send>
+  void emit(Send &send, const ReportSlot &report)
+  {
+    if (!_dedup.isDuplicate(report))
+      send(report);
+  }
+
+  SpscRing<ReportSlot, SLOTS> _rings[PEERS];
+  Coalescer _coalescer;
+  Dedup _dedup;
+};
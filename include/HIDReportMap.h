@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Limits of the parsed layout table
+#define HID_MAX_REPORTS 16
+#define HID_MAX_FIELDS 96
+#define HID_MAX_REPORT_BYTES 64
+
+enum HIDReportType : uint8_t
+{
+  HID_REPORT_INPUT = 0,
+  HID_REPORT_OUTPUT = 1,
+  HID_REPORT_FEATURE = 2,
+  HID_REPORT_TYPES = 3,
+};
+
+// Derived from the top-level application collection a report belongs to
+enum HIDReportKind : uint8_t
+{
+  HID_KIND_UNKNOWN = 0,
+  HID_KIND_KEYBOARD,
+  HID_KIND_MOUSE,
+  HID_KIND_CONSUMER,
+  HID_KIND_GAMEPAD,
+  HID_KIND_VENDOR,
+};
+
+// Main item data bits kept per field
+#define HID_FIELD_CONSTANT 0x01
+#define HID_FIELD_VARIABLE 0x02
+#define HID_FIELD_RELATIVE 0x04
+
+struct HIDField
+{
+  uint16_t bitOffset; // from the start of the payload, report ID excluded
+  uint8_t bitSize;    // size of one element
+  uint16_t count;     // number of elements
+  uint8_t flags;
+  uint16_t usagePage;
+  uint16_t usageMin; // single usage, usage range, or array usage range
+  uint16_t usageMax;
+  int32_t logicalMin;
+  int32_t logicalMax;
+};
+
+struct HIDReportLayout
+{
+  uint8_t id; // 0 when the descriptor does not use report IDs
+  uint8_t type;
+  uint8_t kind;
+  uint8_t fieldCount;
+  uint16_t bitLength; // payload length, report ID excluded
+  uint16_t firstField;
+
+  uint16_t byteLength() const { return (bitLength + 7) / 8; }
+};
+
+// Item-level HID report descriptor parser. parse() runs once per report map
+// and builds a compact table of reports and their fields; lookups afterwards
+// are constant time and safe to use from the report hot path.
+class HIDReportMap
+{
+public:
+  HIDReportMap() { clear(); }
+
+  void clear();
+
+  // Returns false if the descriptor is malformed or exceeds the table limits.
+  // The table is still usable for the reports parsed before the error.
+  bool parse(const uint8_t *data, size_t len);
+
+  const HIDReportLayout *find(uint8_t type, uint8_t reportId) const
+  {
+    uint8_t idx = _index[type][reportId];
+    return idx == NO_REPORT ? nullptr : &_reports[idx];
+  }
+
+  // Input report whose payload has the given length. Used when the transport
+  // does not carry the report ID; ambiguous lengths resolve to the first report.
+  const HIDReportLayout *findInputByLength(size_t len) const
+  {
+    if (len > HID_MAX_REPORT_BYTES || _inputByLength[len] == NO_REPORT)
+      return nullptr;
+    return &_reports[_inputByLength[len]];
+  }
+
+  bool isLengthAmbiguous(size_t len) const
+  {
+    return len <= HID_MAX_REPORT_BYTES && (_ambiguousLengths[len / 8] & (1 << (len % 8)));
+  }
+
+  const HIDField *findField(const HIDReportLayout &report, uint16_t usagePage, uint16_t usage) const;
+
+  bool usesReportIds() const { return _usesReportIds; }
+  size_t reportCount() const { return _reportCount; }
+  const HIDReportLayout &report(size_t i) const { return _reports[i]; }
+  const HIDField *fields(const HIDReportLayout &report) const { return &_fields[report.firstField]; }
+
+  static const char *kindName(uint8_t kind);
+  static const char *typeName(uint8_t type);
+
+private:
+  static const uint8_t NO_REPORT = 0xFF;
+
+  HIDReportLayout *findOrAddReport(uint8_t type, uint8_t reportId, uint8_t kind);
+  bool addField(HIDReportLayout *report, const HIDField &field);
+  void finish();
+
+  HIDReportLayout _reports[HID_MAX_REPORTS];
+  HIDField _fields[HID_MAX_FIELDS];
+  uint8_t _fieldOwner[HID_MAX_FIELDS];
+  uint8_t _reportCount;
+  uint16_t _fieldCount;
+  bool _usesReportIds;
+
+  uint8_t _index[HID_REPORT_TYPES][256];
+  uint8_t _inputByLength[HID_MAX_REPORT_BYTES + 1];
+  uint8_t _ambiguousLengths[(HID_MAX_REPORT_BYTES + 8) / 8];
+};
+
+// Total length of the item starting at item (prefix included), or 0 if it is
+// truncated. Handles both short and long items.
+size_t hidItemSize(const uint8_t *item, size_t remaining);
+
+// Reads an unsigned bit field of up to 32 bits from a report payload
+uint32_t hidReadBits(const uint8_t *data, uint16_t bitOffset, uint8_t bitSize);
+
+// Reads a field element and sign-extends it when its logical range is signed
+int32_t hidReadField(const uint8_t *data, const HIDField &field, uint16_t element);
+
+// Writes an unsigned bit field of up to 32 bits, other bits are preserved
+void hidWriteBits(uint8_t *data, uint16_t bitOffset, uint8_t bitSize, uint32_t value);
+
+// Writes a field element; the value is truncated to the field size
+void hidWriteField(uint8_t *data, const HIDField &field, uint16_t element, int32_t value);
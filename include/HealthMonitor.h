@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+
+// Fault detection, checked every HEALTH_CHECK_INTERVAL ms
+#define HEALTH_CHECK_INTERVAL 250
+#define HEALTH_PROBE_FAILURES 3        // failed link probes (RSSI reads) in a row
+#define HEALTH_UNBOUND_NOTIFIES 4      // notifications on unknown handles per check
+#define HEALTH_USB_FAILURES 5          // SendReport() failures in a row...
+#define HEALTH_USB_STALL_MS 500        // ...and no success for this long
+#define HEALTH_HEARTBEAT_STALL_MS 3000 // forwarding task silent this long
+
+// How long each step gets to clear the fault before the next one runs
+#define HEALTH_RESUBSCRIBE_MS 500
+#define HEALTH_RECONNECT_MS 2000 // the link has to go down in this time
+#define HEALTH_USB_REINIT_MS 3000
+// A USB fault this soon after a re-init cleared the last one goes to reboot
+#define HEALTH_USB_REFAULT_MS 10000
+
+// Graded recovery: each step is tried once, in this order, until the fault
+// clears. BLE faults start at re-subscribing, USB faults at re-init; a
+// wedged forwarding task or a step that cannot complete ends in a reboot.
+enum RecoveryStep : uint8_t
+{
+  RECOVER_RESUBSCRIBE, // rewrite the CCCDs of a linked peer
+  RECOVER_RECONNECT,   // drop the link, the normal reconnect takes over
+  RECOVER_USB_REINIT,  // detach and re-attach USB
+  RECOVER_REBOOT,
+  RECOVER_STEP_COUNT,
+};
+
+// Runs a recovery step: peer index, or HEALTH_USB for USB steps. Returns
+// false if the step could not be started. Implemented by the application.
+typedef bool (*RecoveryAction)(RecoveryStep step, uint8_t peer);
+
+#define HEALTH_USB 0xFF
+
+// Watches link probes, notifications that match no binding, SendReport()
+// results and the forwarding task heartbeat, and walks the recovery steps
+// when one of them goes bad. Every step is counted; the time from fault to
+// recovery is kept per step that cleared it. Reboots are counted across
+// resets in RTC memory.
+class HealthMonitor
+{
+public:
+  void begin(RecoveryAction action);
+
+  // NimBLE host task: a notification for a handle without a binding
+  void onUnboundNotify(uint8_t peer);
+
+  // loop()
+  void onLinkProbe(uint8_t peer, bool ok);
+  void onPeerReady(uint8_t peer);
+  void onPeerDisconnected(uint8_t peer);
+  void setUsbMounted(bool mounted);
+  void poll();
+
+  void print(Print &out) const;
+
+private:
+  struct Domain
+  {
+    bool faulted;
+    uint8_t step;     // step currently running
+    uint32_t faultMs; // when the fault was detected
+    uint32_t stepMs;  // when the current step started
+  };
+
+  struct StepStats
+  {
+    uint32_t attempts;
+    uint32_t recovered; // faults this step cleared
+    uint32_t lastMs;    // fault to recovery
+    uint32_t maxMs;
+  };
+
+  void checkPeer(uint8_t peer);
+  void checkUsb();
+  void start(Domain &domain, uint8_t target, uint8_t step);
+  void escalate(Domain &domain, uint8_t target);
+  void run(Domain &domain, uint8_t target, uint8_t step);
+  void recovered(Domain &domain);
+  static uint32_t stepTimeout(uint8_t step);
+
+  RecoveryAction _action = nullptr;
+  Domain _peers[PROXY_MAX_PEERS] = {};
+  Domain _usb = {};
+  StepStats _steps[RECOVER_STEP_COUNT] = {};
+
+  uint8_t _probeFailures[PROXY_MAX_PEERS] = {};
+  volatile uint16_t _unbound[PROXY_MAX_PEERS] = {};
+  bool _linked[PROXY_MAX_PEERS] = {}; // ready, until the link goes down
+  bool _usbMounted = false;
+  uint32_t _lastCheckMs = 0;
+  uint32_t _usbRecoveredMs = 0; // 0 until a USB re-init cleared a fault
+};
+
+extern HealthMonitor healthMonitor;
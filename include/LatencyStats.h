@@ -0,0 +1,111 @@
+#pragma once
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+// Per-report-ID latency histograms from BLE notification to USB IN
+// completion. Enabled by default; -D PROXY_LATENCY_STATS=0 compiles the
+// LATENCY_* macros to nothing.
+#ifndef PROXY_LATENCY_STATS
+#define PROXY_LATENCY_STATS 1
+#endif
+
+#define LATENCY_MAX_IDS 16
+
+// Log-linear buckets: 16 us steps up to 128 us, then four per octave
+// (12.5% resolution) up to 131 ms; the last bucket also takes anything slower
+#define LATENCY_BUCKETS 48
+#define LATENCY_BUCKET_US 16
+
+enum LatencyStage : uint8_t
+{
+  LATENCY_QUEUE, // BLE notification -> USB task picks the report up
+  LATENCY_SEND,  // HID.SendReport() call -> IN transfer complete
+  LATENCY_TOTAL,
+  LATENCY_STAGES,
+};
+
+// Counters of one report ID, for telemetry
+struct LatencyCounters
+{
+  uint8_t reportId;
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t dropped; // ring full, before the USB task
+  uint32_t merged;  // coalesced into a pending report
+  uint32_t p99Us;
+};
+
+class LatencyStats
+{
+public:
+  // Timestamps are taken on both cores, so they come from esp_timer rather
+  // than the per-core cycle counter
+  static uint32_t now() { return (uint32_t)esp_timer_get_time(); }
+
+  // USB task
+  void record(uint8_t reportId, uint32_t rxUs, uint32_t dequeueUs, uint32_t doneUs);
+  void fail(uint8_t reportId);
+  void merge(uint8_t reportId);
+
+  // BLE host task
+  void drop(uint8_t reportId);
+
+  // loop(); reports in flight while resetting may be lost
+  void reset();
+  void print(Print &out, bool histogram = false);
+
+  // End-to-end percentile over all report IDs, 0 before the first report
+  uint32_t totalPercentileUs(uint8_t percent) const;
+
+  // Report IDs seen so far, in order of first appearance
+  size_t idCount() const { return _used; }
+  void counters(size_t index, LatencyCounters &out) const;
+
+private:
+  struct IdStats
+  {
+    uint8_t reportId;
+    uint32_t count;
+    uint32_t dropped;
+    uint32_t failed;
+    uint32_t merged;
+    uint32_t maxUs[LATENCY_STAGES];
+    uint32_t buckets[LATENCY_STAGES][LATENCY_BUCKETS];
+  };
+
+  IdStats *slot(uint8_t reportId);
+
+  uint8_t _slotOf[256] = {}; // index + 1 into _ids, 0 if not seen yet
+  IdStats _ids[LATENCY_MAX_IDS] = {};
+  uint8_t _used = 0;
+  portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#if PROXY_LATENCY_STATS
+extern LatencyStats latencyStats;
+
+#define LATENCY_STAMP() LatencyStats::now()
+#define LATENCY_RECORD(id, rx, dequeue, done) latencyStats.record(id, rx, dequeue, done)
+#define LATENCY_FAIL(id) latencyStats.fail(id)
+#define LATENCY_DROP(id) latencyStats.drop(id)
+#define LATENCY_MERGE(id) latencyStats.merge(id)
+#else
+#define LATENCY_STAMP() 0
+#define LATENCY_RECORD(id, rx, dequeue, done) \
+  do                                          \
+  {                                           \
+  } while (0)
+#define LATENCY_FAIL(id) \
+  do                     \
+  {                      \
+  } while (0)
+#define LATENCY_DROP(id) \
+  do                     \
+  {                      \
+  } while (0)
+#define LATENCY_MERGE(id) \
+  do                      \
+  {                       \
+  } while (0)
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+
+// Stress rig. With -D PROXY_LOADGEN=1 the firmware does not proxy at all:
+// it advertises as a BLE HID peripheral and notifies vendor-defined input
+// reports at a fixed rate, each carrying a per-report-ID sequence number and
+// its send time. A proxy built with -D PROXY_SEQ_CHECK=1 checks them on
+// arrival and counts loss, reordering and delay spread ("seq" console
+// command); proxy-internal latency is in "stats" as usual.
+#ifndef PROXY_LOADGEN
+#define PROXY_LOADGEN 0
+#endif
+#ifndef PROXY_SEQ_CHECK
+#define PROXY_SEQ_CHECK 0
+#endif
+
+// Report ticks per second
+#ifndef PROXY_LOADGEN_RATE_HZ
+#define PROXY_LOADGEN_RATE_HZ 500
+#endif
+
+// Number of input reports (IDs 1..n, 8, 12, 16 and 20 bytes)
+#ifndef PROXY_LOADGEN_REPORT_IDS
+#define PROXY_LOADGEN_REPORT_IDS 3
+#endif
+
+// 0: one report per tick, report IDs in turn
+// 1: every report ID back to back on each tick
+#ifndef PROXY_LOADGEN_PATTERN
+#define PROXY_LOADGEN_PATTERN 0
+#endif
+
+#define LOADGEN_MAX_REPORT_IDS 4
+#define LOADGEN_DEVICE_NAME "ESP_HID_LoadGen"
+
+// Header at the start of every generated report, little endian
+#define LOADGEN_MAGIC 0xA5
+#define LOADGEN_HEADER_LENGTH 8
+
+struct LoadGenHeader
+{
+  uint8_t magic;
+  uint8_t reportId;
+  uint16_t seq;
+  uint32_t sentUs; // generator clock
+} __attribute__((packed));
+
+static_assert(sizeof(LoadGenHeader) == LOADGEN_HEADER_LENGTH, "LoadGenHeader layout");
+
+// Peripheral side
+class LoadGenerator
+{
+public:
+  void begin();
+
+  // Prints progress once per second; call from loop()
+  void poll();
+
+  // NimBLE callbacks
+  void onSubscribe(uint8_t reportId, bool subscribed);
+  void onDisconnect();
+
+private:
+  static void taskEntry(void *arg);
+  static void tick(void *arg);
+  void run();
+  bool send(uint8_t index);
+
+  TaskHandle_t _task = nullptr;
+  void *_reports[LOADGEN_MAX_REPORT_IDS] = {}; // NimBLECharacteristic
+  uint16_t _seq[LOADGEN_MAX_REPORT_IDS] = {};
+  volatile uint8_t _subscribed = 0; // bit per report index
+  volatile uint32_t _sent = 0;
+  volatile uint32_t _busy = 0; // notification refused, no buffer
+  uint32_t _lastPrintMs = 0;
+  uint32_t _lastSent = 0;
+};
+
+// Proxy side, fed from the report path (NimBLE host task)
+class SeqCheck
+{
+public:
+  void onReport(uint8_t peer, const uint8_t *data, size_t length, uint32_t rxUs);
+  void reset();
+  void print(Print &out) const;
+
+private:
+  struct Stream
+  {
+    bool started;
+    uint16_t expected;
+    uint32_t received;
+    uint32_t lost;      // sequence numbers skipped
+    uint32_t reordered; // arrived after a later one
+    uint32_t duplicates;
+    int32_t minDelayUs; // rx - sent, clock offset included
+    int32_t maxDelayUs;
+  };
+
+  Stream _streams[PROXY_MAX_PEERS][LOADGEN_MAX_REPORT_IDS] = {};
+};
+
+#if PROXY_LOADGEN
+extern LoadGenerator loadGen;
+#endif
+#if PROXY_SEQ_CHECK
+extern SeqCheck seqCheck;
+#endif
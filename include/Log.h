@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Compile-time log levels. Anything above PROXY_LOG_LEVEL is removed by the
+// preprocessor, arguments included, so disabled logging costs nothing.
+#define PROXY_LOG_NONE 0
+#define PROXY_LOG_ERROR 1
+#define PROXY_LOG_WARN 2
+#define PROXY_LOG_INFO 3
+#define PROXY_LOG_DEBUG 4
+#define PROXY_LOG_VERBOSE 5
+
+#ifndef PROXY_LOG_LEVEL
+#define PROXY_LOG_LEVEL PROXY_LOG_INFO
+#endif
+
+#define LOG_DISCARD(...) \
+  do                     \
+  {                      \
+  } while (0)
+
+#if PROXY_LOG_LEVEL >= PROXY_LOG_ERROR
+#define LOGE(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOGE(...) LOG_DISCARD()
+#endif
+
+#if PROXY_LOG_LEVEL >= PROXY_LOG_WARN
+#define LOGW(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOGW(...) LOG_DISCARD()
+#endif
+
+#if PROXY_LOG_LEVEL >= PROXY_LOG_INFO
+#define LOGI(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOGI(...) LOG_DISCARD()
+#endif
+
+#if PROXY_LOG_LEVEL >= PROXY_LOG_DEBUG
+#define LOGD(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOGD(...) LOG_DISCARD()
+#endif
+
+// Verbose is the only level allowed on the report hot path
+#if PROXY_LOG_LEVEL >= PROXY_LOG_VERBOSE
+#define LOGV(...) Serial.printf(__VA_ARGS__)
+#else
+#define LOGV(...) LOG_DISCARD()
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Distinct (report ID, type) pairs tracked; keyboards use one LED report
+#define OUTPUT_RELAY_SLOTS 8
+
+// Longer output/feature reports are not relayed
+#define OUTPUT_REPORT_MAX_LENGTH 32
+
+// Minimum time between two flushes; changes in between are batched
+#define OUTPUT_FLUSH_INTERVAL_MS 20
+
+typedef void (*OutputWriter)(uint8_t usbReportId, uint8_t type, const uint8_t *data, size_t length);
+
+// Host -> peer back channel for output and feature reports (LED state).
+// The USB task only records the latest value per report; loop() writes
+// what changed at most once per OUTPUT_FLUSH_INTERVAL_MS, so an LED storm
+// from the host costs one BLE write per report and window, and a value
+// equal to the one last written costs none.
+class OutputRelay
+{
+public:
+  // USB task (USBHIDDevice callbacks)
+  void submit(uint8_t usbReportId, uint8_t type, const uint8_t *data, size_t length);
+
+  // loop() only. Returns true while changes are still waiting for the window.
+  bool flush(OutputWriter write);
+
+  // Milliseconds until waiting changes are due, UINT32_MAX if none are
+  // waiting. loop() sleeps no longer than this, since a change submitted
+  // inside the window posts no event of its own.
+  uint32_t flushDelayMs() const;
+
+  // Marks every known value as changed, e.g. for a peer that just connected
+  void resync();
+
+  uint32_t writtenCount() const { return _written; }
+  uint32_t dedupedCount() const { return _deduped; }
+
+private:
+  struct Entry
+  {
+    uint8_t reportId;
+    uint8_t type;
+    uint8_t length;
+    bool pending;
+    uint8_t data[OUTPUT_REPORT_MAX_LENGTH];
+  };
+
+  Entry _entries[OUTPUT_RELAY_SLOTS];
+  uint8_t _count = 0;
+  bool _anyPending = false;
+  uint32_t _lastFlushMs = 0;
+  portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t _written = 0;
+  volatile uint32_t _deduped = 0; // unchanged, or replaced before being written
+};
+
+extern OutputRelay outputRelay;
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+
+// How a link got encrypted
+enum SecurityPath : uint8_t
+{
+  SECURITY_RESUMED, // bonded peer, encryption started from the stored LTK
+  SECURITY_PAIRED,  // full pairing (new peer, or a bond the peer lost)
+  SECURITY_PATH_COUNT,
+};
+
+// Time from connection to encryption per peer, split by path, so the cost
+// of re-pairing shows up next to the fast reconnect it replaces
+class PairingStats
+{
+public:
+  // Security started; NimBLE host task or loop()
+  void begin(uint8_t peer, SecurityPath path);
+  // Encryption change event; NimBLE host task
+  void complete(uint8_t peer, bool encrypted);
+  // A stored key was rejected and the peer is paired again; loop()
+  void fallback(uint8_t peer);
+  // No encryption change before the timeout; loop()
+  void timeout(uint8_t peer);
+
+  SecurityPath path(uint8_t peer) const { return (SecurityPath)_peers[peer].path; }
+
+  void print(Print &out) const;
+  void reset();
+
+private:
+  struct PathStats
+  {
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t lastMs;
+    uint32_t maxMs;
+    uint32_t totalMs;
+  };
+
+  struct PeerTiming
+  {
+    uint32_t startMs;
+    uint8_t path;
+    bool pending;
+  };
+
+  PathStats _paths[SECURITY_PATH_COUNT] = {};
+  PeerTiming _peers[PROXY_MAX_PEERS] = {};
+  uint32_t _fallbacks = 0;
+  uint32_t _timeouts = 0;
+  mutable portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern PairingStats pairingStats;
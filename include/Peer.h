@@ -0,0 +1,46 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+#include "ProxyConfig.h"
+#include "HIDReportMap.h"
+#include "ReportBindings.h"
+#include "PipelineStages.h"
+#include "BootReports.h"
+
+// HOGP limits the Report Map characteristic to 512 bytes
+#define PEER_REPORT_MAP_CAPACITY 512
+
+enum PeerState : uint8_t
+{
+  PEER_IDLE,        // no link
+  PEER_CONNECTING,  // connection attempt in progress
+  PEER_SECURING,    // connected, waiting for encryption
+  PEER_DISCOVERING, // reading report map, subscribing
+  PEER_READY,       // forwarding reports
+};
+
+// One BLE HID peripheral slot. A slot keeps its address and report map after
+// a disconnect, so the same device reconnects with the same USB report IDs.
+struct Peer
+{
+  NimBLEClient *client = nullptr;
+  NimBLEAdvertisedDevice *advDevice = nullptr; // pending connection
+  NimBLEAddress address;
+  NimBLEAddress identity; // identity address once bonded, key of the NVS cache
+  uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE;
+  PeerState state = PEER_IDLE;
+  uint32_t stateSince = 0;   // millis() of the last state change
+  bool connected = false;    // link up, written by the NimBLE host task
+  bool cacheInvalid = false; // a cached handle was rejected by the peer
+  bool securing = false;     // encryption started on connect, NimBLE host task
+  bool repairing = false;    // stored key rejected, pairing from scratch
+
+  uint8_t reportMapData[PEER_REPORT_MAP_CAPACITY];
+  size_t reportMapSize = 0; // 0 until the report map has been read
+  HIDReportMap reportMap;
+  TransformStage transform; // compiled from transformConfig against reportMap
+  BootTranslator boot;       // reportMap -> synthesized USB reports
+  ReportBindings bindings;
+  uint16_t batteryHandle = 0;
+  uint8_t usbReportIds[256] = {}; // peer report ID -> USB report ID, 0 = not exposed
+};
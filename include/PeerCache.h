@@ -0,0 +1,52 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+#include "CompositeDescriptor.h"
+#include "ReportBindings.h"
+
+// Bump whenever the layout of PeerCacheEntry changes
+#define PEER_CACHE_VERSION 1
+
+// Largest report map kept in NVS
+#define PEER_CACHE_MAX_REPORT_MAP USB_DESCRIPTOR_CAPACITY
+
+struct CachedReport
+{
+  uint16_t handle;
+  uint16_t cccdHandle; // 0 if the report cannot notify
+  uint8_t reportId;
+  uint8_t type;
+  uint8_t indicate; // subscribe with indications instead of notifications
+  uint8_t reserved;
+};
+
+// Everything needed to resume a bonded peer without GATT discovery
+struct PeerCacheEntry
+{
+  uint8_t version;
+  uint8_t reportCount;
+  uint16_t reportMapSize;
+  uint16_t batteryHandle;
+  uint16_t batteryCccdHandle;
+  CachedReport reports[MAX_REPORT_BINDINGS];
+};
+
+// Per-bond cache of report map and GATT handles in NVS, keyed by the peer's
+// identity address
+class PeerCache
+{
+public:
+  // Fills entry and reportMap (capacity bytes). Returns false on a miss or
+  // if the stored entry is from another firmware version.
+  bool load(const NimBLEAddress &address, PeerCacheEntry &entry, uint8_t *reportMap, size_t capacity);
+
+  bool store(const NimBLEAddress &address, const PeerCacheEntry &entry, const uint8_t *reportMap);
+
+  void remove(const NimBLEAddress &address);
+  void clear();
+
+private:
+  static void makeKey(char *key, const NimBLEAddress &address, char suffix);
+};
+
+extern PeerCache peerCache;
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ReportTransform.h"
+#include "ReportCoalescer.h"
+#include "ReportDedup.h"
+
+// Build-time selection of the optional forwarding stages:
+//
+//   BLE notification -> classify -> [transform] -> ring -> [coalesce] -> [dedup] -> USB
+//
+// A disabled stage is replaced by an empty inline type with the same
+// interface and constant results, so the compiler removes it and the
+// branches around it. The hot path of a build never tests configuration
+// at run time. Build environments in platformio.ini pick the stages.
+#ifndef PROXY_STAGE_TRANSFORM
+#define PROXY_STAGE_TRANSFORM 1
+#endif
+#ifndef PROXY_STAGE_COALESCE
+#define PROXY_STAGE_COALESCE 1
+#endif
+#ifndef PROXY_STAGE_DEDUP
+#define PROXY_STAGE_DEDUP 1
+#endif
+
+// Reports go out unchanged
+class NullTransform
+{
+public:
+  void clear() {}
+  void compile(const HIDReportMap &, const TransformConfig &) {}
+  bool drops(uint8_t) const { return false; }
+  void apply(uint8_t, uint8_t *, size_t) {}
+};
+
+// Every report is sent on its own, in arrival order
+class NullCoalescer
+{
+public:
+  void clear() {}
+  void configure(const HIDReportMap &) {}
+  CoalesceResult add(const ReportSlot &) { return COALESCE_BYPASS; }
+
+  size_t pendingCount() const { return 0; }
+  const ReportSlot &pending(size_t) const { return _none; }
+  const ReportSlot *findPending(uint8_t) const { return nullptr; }
+  void removePending(uint8_t) {}
+  void clearPending() {}
+
+  uint32_t mergedCount() const { return 0; }
+
+private:
+  ReportSlot _none = {};
+};
+
+// Repeats are sent like any other report
+class NullDedup
+{
+public:
+  void clear() {}
+  void configure(const HIDReportMap &, uint8_t = 0) {}
+  bool isDuplicate(const ReportSlot &) { return false; }
+  void forget(uint8_t) {}
+  void invalidate() {}
+
+  uint32_t suppressedCount() const { return 0; }
+  size_t idCount() const { return 0; }
+  uint8_t reportId(size_t) const { return 0; }
+  uint32_t suppressedCount(size_t) const { return 0; }
+};
+
+#if PROXY_STAGE_TRANSFORM
+typedef ReportTransform TransformStage;
+#else
+typedef NullTransform TransformStage;
+#endif
+
+#if PROXY_STAGE_COALESCE
+typedef ReportCoalescer CoalesceStage;
+#else
+typedef NullCoalescer CoalesceStage;
+#endif
+
+#if PROXY_STAGE_DEDUP
+typedef ReportDedup DedupStage;
+#else
+typedef NullDedup DedupStage;
+#endif
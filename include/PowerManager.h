@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+#include "StatusDisplay.h"
+
+// Idle power management. Defaults can be overridden with -D flags.
+#ifndef PROXY_POWER_MANAGEMENT
+#define PROXY_POWER_MANAGEMENT 1
+#endif
+
+// Seconds without reports before the CPU may slow down and sleep
+#ifndef PROXY_IDLE_SLEEP_S
+#define PROXY_IDLE_SLEEP_S 10
+#endif
+// Seconds without activity before the backlight dims, then turns off
+#ifndef PROXY_IDLE_DIM_S
+#define PROXY_IDLE_DIM_S 30
+#endif
+#ifndef PROXY_IDLE_OFF_S
+#define PROXY_IDLE_OFF_S 120
+#endif
+
+// Dimmed backlight level, out of UI_BACKLIGHT_FULL
+#ifndef PROXY_BACKLIGHT_DIM
+#define PROXY_BACKLIGHT_DIM 24
+#endif
+
+// Lowest CPU clock while idle (dynamic frequency scaling)
+#ifndef PROXY_IDLE_CPU_MHZ
+#define PROXY_IDLE_CPU_MHZ 80
+#endif
+
+// loop() housekeeping period while idle; events still wake it at once
+#define POWER_IDLE_POLL_INTERVAL 500
+
+enum PowerState : uint8_t
+{
+  POWER_ACTIVE, // full clock, no light sleep
+  POWER_IDLE,   // clock scaling and (tickless idle builds) light sleep allowed
+};
+
+// Holds ESP-IDF power management locks while reports flow and lets them go
+// once the peers have been quiet for a while, and dims the display in
+// steps. Needs an ESP-IDF built with CONFIG_PM_ENABLE; light sleep also
+// needs CONFIG_FREERTOS_USE_TICKLESS_IDLE. Without them only the display
+// part is active.
+//
+// Automatic light sleep is only allowed while USB is not mounted (or the
+// host suspended the bus): the USB peripheral does not run in light sleep.
+class PowerManager
+{
+public:
+  void begin();
+
+  // Any task, once per report or event: cheap, and returns to full power
+  // before the caller goes on
+  void onActivity();
+
+  void setUsbActive(bool active);
+
+  // loop(): steps down the power and display states
+  void poll();
+
+  PowerState state() const { return _state; }
+  uint32_t wakeCount() const { return _wakes; }
+
+private:
+  void acquire();
+  void release();
+
+  volatile uint32_t _lastActivityMs = 0;
+  volatile PowerState _state = POWER_ACTIVE;
+  volatile bool _displayDimmed = false;
+  bool _usbActive = false;
+  uint8_t _backlight = UI_BACKLIGHT_FULL; // last level set by poll()
+  uint32_t _wakes = 0;
+  portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern PowerManager powerManager;
@@ -0,0 +1,48 @@
+#pragma once
+
+// Build-time proxy configuration. Every value can be overridden with a
+// -D flag in platformio.ini.
+
+// Number of BLE HID peripherals proxied at the same time
+#ifndef PROXY_MAX_PEERS
+#define PROXY_MAX_PEERS 2
+#endif
+
+// What the USB side exposes: 0 mirrors the peers' report maps (falling back
+// to 1 when they do not fit), 1 always serves a synthesized boot keyboard +
+// mouse + consumer descriptor, see BootReports.h
+#define USB_MODE_MIRROR 0
+#define USB_MODE_BOOT 1
+#ifndef PROXY_USB_MODE
+#define PROXY_USB_MODE USB_MODE_MIRROR
+#endif
+
+// Connection parameter profile, see ConnTuner.h
+// (0 low latency, 1 balanced, 2 low power)
+#ifndef PROXY_CONN_PROFILE
+#define PROXY_CONN_PROFILE 1
+#endif
+
+// Threading plan. The NimBLE host task runs on the core set with
+// CONFIG_BT_NIMBLE_PINNED_TO_CORE (together with the controller and, on a
+// coexistence build, Wi-Fi). Report forwarding gets the other core to
+// itself at a priority nothing else on that core reaches; display and
+// loop() (events, console, logging) only run when it is waiting.
+#ifndef PROXY_USB_TASK_CORE
+#define PROXY_USB_TASK_CORE 1
+#endif
+#ifndef PROXY_USB_TASK_PRIORITY
+#define PROXY_USB_TASK_PRIORITY (configMAX_PRIORITIES - 3)
+#endif
+
+#ifndef PROXY_UI_TASK_CORE
+#define PROXY_UI_TASK_CORE 0
+#endif
+#ifndef PROXY_UI_TASK_PRIORITY
+#define PROXY_UI_TASK_PRIORITY 1
+#endif
+
+// loop() stays on the core Arduino started it on (ARDUINO_RUNNING_CORE)
+#ifndef PROXY_LOOP_TASK_PRIORITY
+#define PROXY_LOOP_TASK_PRIORITY 1
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Events that move the scan/connect/secure/discover/enumerate sequence
+// forward. Posted from NimBLE and USB callbacks, consumed by loop().
+enum ProxyEventType : uint8_t
+{
+  EVENT_SCAN_END,
+  EVENT_CONNECTED,
+  EVENT_CONNECT_FAILED,
+  EVENT_SECURED,
+  EVENT_DISCONNECTED,
+  EVENT_CACHE_INVALID,
+  EVENT_USB_MOUNTED,
+  EVENT_USB_UNMOUNTED,
+  EVENT_PEER_ACTIVE,     // report rate picked up on an idle link
+  EVENT_OUTPUT_REPORT,   // host sent an output/feature report, see OutputRelay
+  EVENT_REPORT_MAP_READ, // a peer's report map read ended, see setupPeer
+  EVENT_TYPE_COUNT,
+};
+
+struct ProxyEvent
+{
+  uint8_t type;
+  uint8_t peer;   // index into the peer table, if the event has one
+  int16_t status; // event specific: reason code, success flag
+};
+
+// EVENT_SECURED status
+enum SecureResult : int16_t
+{
+  SECURE_FAILED,
+  SECURE_OK,
+  SECURE_KEY_MISSING, // the peer no longer has the bond we hold for it
+};
+
+#define PROXY_EVENT_QUEUE_LENGTH 16
+
+void proxyEventsBegin();
+
+// Safe to call from any task; never blocks
+bool postEvent(uint8_t type, uint8_t peer = 0, int16_t status = 0);
+
+// Blocks the caller until an event arrives or timeoutMs elapses
+bool waitEvent(ProxyEvent &event, uint32_t timeoutMs);
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+#include "USBHID.h"
+#include "CompositeDescriptor.h"
+
+// Time the device stays detached so the host notices a descriptor change
+#define USB_REATTACH_DELAY_MS 50
+
+// USB HID device serving the (composite) report map of the BLE peers
+class ProxyHIDDevice : public USBHIDDevice
+{
+public:
+  // Registers the device with USBHID; call before HID.begin()
+  bool begin();
+
+  // Loads the descriptor served before the last reboot from NVS, so USB can
+  // enumerate at boot with what the peers will most likely ask for again
+  bool loadCached();
+
+  // Replaces the report descriptor. An identical descriptor (same hash) is a
+  // no-op. Before enumeration a new one is only stored; afterwards the
+  // host-visible copy is rewritten and the device detaches and re-attaches
+  // so the host reads it again. New descriptors are written to NVS. One of
+  // another length than registered needs a restart, see restartPending().
+  bool setDescriptor(const uint8_t *desc, uint16_t len);
+
+  // Detaches from the host and attaches again, making it enumerate anew:
+  // after a descriptor change, or to recover a wedged endpoint
+  void reattach();
+
+  const uint8_t *descriptor() const { return _descriptor; }
+  uint16_t descriptorLength() const { return _descriptorLength; }
+  uint32_t descriptorHash() const { return _descriptorHash; }
+  uint32_t reattachCount() const { return _reattachCount; }
+
+  // The stored descriptor has another length than the registered one; only
+  // a restart can register it
+  bool restartPending() const { return _restartPending; }
+
+  uint16_t _onGetDescriptor(uint8_t *buffer) override;
+
+  // Host output/feature reports, handed to outputRelay (USB task)
+  void _onOutput(uint8_t report_id, const uint8_t *buffer, uint16_t len) override;
+  void _onSetFeature(uint8_t report_id, const uint8_t *buffer, uint16_t len) override;
+
+private:
+  void storeCached();
+
+  uint8_t _descriptor[USB_DESCRIPTOR_CAPACITY];
+  uint16_t _descriptorLength = 0;
+  uint32_t _descriptorHash = 0;
+  uint32_t _reattachCount = 0;
+  uint16_t _registeredLength = 0; // what USBHID reserved for us in its buffer
+  uint8_t *_usbBuffer = nullptr;  // USBHID's copy, kept after the first request
+  bool _restartPending = false;
+};
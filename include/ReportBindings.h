@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HIDReportMap.h"
+
+#define MAX_REPORT_BINDINGS 16
+
+// Report ID and type of one BLE Report characteristic, taken from its
+// Report Reference descriptor at subscribe time
+struct ReportBinding
+{
+  uint16_t handle;
+  uint8_t reportId;
+  uint8_t type;
+  uint16_t length;
+  const HIDReportLayout *layout; // nullptr if the report map lacks this report
+};
+
+// Characteristic handle -> report binding. Built once per connection before
+// notifications are enabled, then only read from the notification path.
+class ReportBindings
+{
+public:
+  ReportBindings() { clear(); }
+
+  void clear()
+  {
+    _count = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+      _buckets[i] = EMPTY;
+  }
+
+  bool add(uint16_t handle, uint8_t reportId, uint8_t type, const HIDReportLayout *layout)
+  {
+    if (_count >= MAX_REPORT_BINDINGS || find(handle))
+      return false;
+
+    ReportBinding &binding = _bindings[_count];
+    binding.handle = handle;
+    binding.reportId = reportId;
+    binding.type = type;
+    binding.length = layout ? layout->byteLength() : 0;
+    binding.layout = layout;
+
+    size_t bucket = handle & (BUCKETS - 1);
+    while (_buckets[bucket] != EMPTY)
+      bucket = (bucket + 1) & (BUCKETS - 1);
+    _buckets[bucket] = _count++;
+    return true;
+  }
+
+  const ReportBinding *find(uint16_t handle) const
+  {
+    size_t bucket = handle & (BUCKETS - 1);
+    while (_buckets[bucket] != EMPTY)
+    {
+      const ReportBinding &binding = _bindings[_buckets[bucket]];
+      if (binding.handle == handle)
+        return &binding;
+      bucket = (bucket + 1) & (BUCKETS - 1);
+    }
+    return nullptr;
+  }
+
+  size_t count() const { return _count; }
+  const ReportBinding &at(size_t i) const { return _bindings[i]; }
+
+private:
+  // Twice the binding count keeps probe chains short
+  static const size_t BUCKETS = 2 * MAX_REPORT_BINDINGS;
+  static const uint8_t EMPTY = 0xFF;
+
+  ReportBinding _bindings[MAX_REPORT_BINDINGS];
+  uint8_t _buckets[BUCKETS];
+  uint8_t _count;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HIDReportMap.h"
+#include "ReportSlot.h"
+#include "ProxyConfig.h"
+
+// Reports with distinct IDs that can wait for the USB endpoint at once
+#define COALESCE_MAX_PENDING (PROXY_MAX_PEERS * HID_MAX_REPORTS)
+
+// Fields a mergeable report may have; larger reports are last-value-wins
+#define COALESCE_MAX_FIELDS 8
+
+enum CoalesceMode : uint8_t
+{
+  COALESCE_REPLACE, // state reports (absolute values): last value wins
+  COALESCE_MERGE,   // relative deltas are summed while the buttons stay the same
+  COALESCE_HOLD,    // keyboard, consumer: folds only while the key state is unchanged
+};
+
+enum CoalesceResult : uint8_t
+{
+  COALESCE_QUEUED,  // no report with this ID was pending
+  COALESCE_MERGED,  // folded into the pending report
+  COALESCE_CONFLICT, // cannot be merged, the pending report must be sent first
+  COALESCE_BYPASS,   // no coalescing stage in this build: send the report now
+};
+
+// Merges queued input reports into one pending report per USB report ID
+// while the endpoint is busy. Motion and keystrokes are never lost: a delta
+// that would overflow its field, or any change of button or key state, is a
+// conflict that makes the caller send the pending report before queueing the
+// new one. Every state the pending report held thus reaches the host.
+class ReportCoalescer
+{
+public:
+  ReportCoalescer() { clear(); }
+
+  void clear();
+
+  // Derives a rule for every input report of the descriptor served over USB
+  void configure(const HIDReportMap &map);
+
+  CoalesceResult add(const ReportSlot &report);
+
+  // Pending reports in order of first arrival
+  size_t pendingCount() const { return _pendingCount; }
+  const ReportSlot &pending(size_t i) const { return _pending[i]; }
+  const ReportSlot *findPending(uint8_t reportId) const;
+  void removePending(uint8_t reportId);
+  void clearPending();
+
+  uint32_t mergedCount() const { return _merged; }
+
+private:
+  struct Rule
+  {
+    uint8_t mode;
+    uint8_t fieldCount; // COALESCE_HOLD with 0 fields: any change conflicts
+    HIDField fields[COALESCE_MAX_FIELDS];
+  };
+
+  static bool buildHoldRule(Rule &rule, const HIDReportMap &map, const HIDReportLayout &report);
+  static bool merge(const Rule &rule, ReportSlot &pending, const ReportSlot &report);
+  static bool changesKeys(const Rule &rule, const ReportSlot &pending, const ReportSlot &report);
+
+  Rule _rules[COALESCE_MAX_PENDING];
+  uint8_t _ruleOf[256]; // index + 1 into _rules, 0 for last-value-wins
+  uint8_t _ruleCount;
+
+  ReportSlot _pending[COALESCE_MAX_PENDING];
+  uint8_t _pendingOf[256]; // index + 1 into _pending
+  uint8_t _pendingCount;
+  uint32_t _merged;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HIDReportMap.h"
+#include "ReportSlot.h"
+#include "ReportCoalescer.h"
+
+// Report kinds whose exact repeats are not sent again, one bit per
+// HIDReportKind. Keyboards and consumer controls resend unchanged state
+// (held keys, keepalives); the host already has it. Reports with relative
+// fields are never deduplicated: a repeated delta is more motion.
+#ifndef PROXY_DEDUP_KINDS
+#define PROXY_DEDUP_KINDS ((1 << HID_KIND_KEYBOARD) | (1 << HID_KIND_CONSUMER))
+#endif
+
+// Last report sent per USB report ID, compared with the next one. USB task
+// only.
+class ReportDedup
+{
+public:
+  ReportDedup() { clear(); }
+
+  void clear();
+
+  // Picks the report IDs of the served descriptor that are deduplicated,
+  // and forgets what was sent before
+  void configure(const HIDReportMap &map, uint8_t kinds = PROXY_DEDUP_KINDS);
+
+  // True if the report repeats the last one sent with its ID; otherwise it
+  // becomes the last one sent
+  bool isDuplicate(const ReportSlot &report);
+
+  // The last report did not reach the host (failed send), or the host lost
+  // its state (re-enumeration): send the next one whatever it holds
+  void forget(uint8_t reportId);
+  void invalidate();
+
+  uint32_t suppressedCount() const { return _suppressed; }
+  size_t idCount() const { return _entryCount; }
+  uint8_t reportId(size_t i) const { return _entries[i].reportId; }
+  uint32_t suppressedCount(size_t i) const { return _entries[i].suppressed; }
+
+private:
+  struct Entry
+  {
+    uint8_t reportId;
+    uint8_t length; // 0 until a report was sent
+    uint32_t suppressed;
+    alignas(4) uint8_t data[REPORT_SLOT_SIZE];
+  };
+
+  Entry _entries[COALESCE_MAX_PENDING];
+  uint8_t _entryOf[256]; // index + 1 into _entries, 0 if not deduplicated
+  uint8_t _entryCount;
+  uint32_t _suppressed;
+};
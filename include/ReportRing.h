@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Single-producer/single-consumer lock-free ring of fixed-size slots.
+// The producer and consumer may run on different cores; the only shared
+// state is the pair of free-running indices, published with acquire/release.
+template <typename T, size_t N>
+class SpscRing
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+  // Producer: returns the next free slot, or nullptr if the ring is full.
+  // The slot is not visible to the consumer until commitPush().
+  T *beginPush()
+  {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head - _tail.load(std::memory_order_acquire) >= N)
+      return nullptr;
+    return &_slots[head & (N - 1)];
+  }
+
+  void commitPush()
+  {
+    _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool push(const T &value)
+  {
+    T *slot = beginPush();
+    if (!slot)
+      return false;
+    *slot = value;
+    commitPush();
+    return true;
+  }
+
+  // Consumer: returns the oldest filled slot, or nullptr if the ring is empty.
+  // The slot stays owned by the consumer until pop().
+  T *front()
+  {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire))
+      return nullptr;
+    return &_slots[tail & (N - 1)];
+  }
+
+  void pop()
+  {
+    _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  bool empty() const
+  {
+    return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+  }
+
+  size_t size() const
+  {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return N; }
+
+private:
+  T _slots[N];
+  std::atomic<size_t> _head{0}; // written by the producer only
+  std::atomic<size_t> _tail{0}; // written by the consumer only
+};
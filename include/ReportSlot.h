@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Largest report payload (without report ID) that fits in a slot
+#define REPORT_SLOT_SIZE 64
+
+// One input report on its way from BLE to USB
+struct ReportSlot
+{
+  uint32_t rxUs; // LATENCY_STAMP() of the BLE notification
+  uint8_t reportId;
+  uint8_t length;
+  alignas(4) uint8_t data[REPORT_SLOT_SIZE]; // word aligned for memcpy() and memcmp()
+};
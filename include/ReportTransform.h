@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "HIDReportMap.h"
+
+// Operations compiled for all reports of one peer
+#define TRANSFORM_MAX_OPS 32
+
+// What to change in forwarded reports. Defaults come from TransformRules.h.
+struct TransformConfig
+{
+  uint8_t keyRemap[256]; // keyboard usage -> usage, identity if unchanged
+  int16_t mouseScaleQ8;
+  bool invertX;
+  bool invertY;
+  bool invertWheel;
+  uint32_t dropKinds;   // bit per HIDReportKind
+  uint8_t dropIds[32];  // bit per peer report ID
+
+  void loadDefaults();
+};
+
+extern TransformConfig transformConfig;
+
+// A TransformConfig compiled against one peer's report map. compile() runs
+// at connect time and resolves every rule to byte offsets and lookup tables,
+// so apply() on the report path is a handful of table lookups per report.
+class ReportTransform
+{
+public:
+  ReportTransform() { clear(); }
+
+  void clear();
+  void compile(const HIDReportMap &map, const TransformConfig &config);
+
+  bool drops(uint8_t reportId) const { return _drop[reportId / 8] & (1 << (reportId % 8)); }
+
+  // Transforms an input report payload in place. NimBLE host task only.
+  void apply(uint8_t reportId, uint8_t *data, size_t length);
+
+private:
+  enum OpType : uint8_t
+  {
+    OP_KEYS,      // byte array of keyboard usages, through _keyMap
+    OP_MODIFIERS, // modifier bitmap byte, through _modifierMap
+    OP_SCALE,     // relative axis element, scaled and/or inverted
+  };
+
+  struct Op
+  {
+    uint8_t type;
+    uint8_t bitSize;
+    uint16_t bitOffset;
+    uint16_t count;      // bytes for OP_KEYS
+    int16_t scaleQ8;     // negative to invert
+    int16_t residual;    // sub-unit motion carried into the next report
+    int32_t logicalMin;
+    int32_t logicalMax;
+  };
+
+  struct Range
+  {
+    uint8_t first;
+    uint8_t count;
+  };
+
+  bool addOp(const Op &op);
+
+  uint8_t _drop[32];
+  uint8_t _rangeOf[256]; // index + 1 into _ranges, 0 = forwarded unchanged
+  Range _ranges[HID_MAX_REPORTS];
+  uint8_t _rangeCount;
+  Op _ops[TRANSFORM_MAX_OPS];
+  uint8_t _opCount;
+
+  uint8_t _keyMap[256];
+  uint8_t _modifierMap[256];
+};
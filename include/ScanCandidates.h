@@ -0,0 +1,63 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+
+// Advertisers remembered per full scan
+#define SCAN_MAX_CANDIDATES 8
+
+// Advertisers weaker than this are ignored; a keyboard or mouse at least
+// this strong is connected to without waiting for the scan to end
+#ifndef SCAN_MIN_RSSI
+#define SCAN_MIN_RSSI -85
+#endif
+#ifndef SCAN_STRONG_RSSI
+#define SCAN_STRONG_RSSI -60
+#endif
+
+// GAP appearance values of HID devices
+#define APPEARANCE_HID_GENERIC 0x03C0
+#define APPEARANCE_HID_KEYBOARD 0x03C1
+#define APPEARANCE_HID_MOUSE 0x03C2
+
+struct ScanCandidate
+{
+  NimBLEAdvertisedDevice device; // copied in place, the buffers are reused
+  int16_t score;
+  bool confident;  // worth connecting to right away
+  uint32_t seenMs; // millis() of the last advertisement
+};
+
+// Ranks HID advertisers seen during a scan by bond status, appearance and
+// RSSI, so the proxy connects to the most likely device instead of the
+// first one that happened to advertise. Filled from the NimBLE host task;
+// loop() only takes from it while no scan is running. Devices live in a
+// fixed table, so recording advertisements does not allocate once every
+// slot has been used; only a device that is taken is copied to the heap.
+class ScanCandidates
+{
+public:
+  void clear() { _count = 0; }
+
+  // Scores and records an advertiser, keeping the best SCAN_MAX_CANDIDATES.
+  // Returns the candidate, or nullptr if it was rejected or ranked out.
+  const ScanCandidate *add(const NimBLEAdvertisedDevice &device);
+
+  // Hands out a copy of the best remaining candidate; the caller owns it
+  NimBLEAdvertisedDevice *takeBest();
+
+  // Hands out a copy of a specific candidate, e.g. one that is connected to early
+  NimBLEAdvertisedDevice *take(const NimBLEAddress &address);
+
+  // Drops candidates not heard from for maxAgeMs
+  void expire(uint32_t maxAgeMs);
+
+  size_t count() const { return _count; }
+
+private:
+  static void score(const NimBLEAdvertisedDevice &device, ScanCandidate &candidate);
+  int find(const NimBLEAddress &address) const;
+  void remove(int index);
+
+  ScanCandidate _candidates[SCAN_MAX_CANDIDATES];
+  size_t _count = 0;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyConfig.h"
+
+// Push finished regions to the panel with DMA on the FSPI port
+#ifndef PROXY_UI_DMA
+#define PROXY_UI_DMA 1
+#endif
+
+// Display task stack; core and priority are in ProxyConfig.h
+#define UI_TASK_STACK 4096
+
+// Minimum time between two redraws
+#define UI_FRAME_INTERVAL_MS 50
+
+#define UI_NAME_LENGTH 20
+
+// Backlight PWM on TFT_BL
+#define UI_BACKLIGHT_FULL 255
+#define UI_BACKLIGHT_PWM_CHANNEL 0
+#define UI_BACKLIGHT_PWM_HZ 5000
+
+// What the proxy is doing right now, shown in the phase row
+enum UiPhase : uint8_t
+{
+  UI_BOOT,
+  UI_SCANNING,
+  UI_RECONNECTING,
+  UI_CONNECTING,
+  UI_CONNECTED,
+  UI_DISCONNECTED,
+  UI_CONNECT_FAILED,
+};
+
+#define UI_BATTERY_UNKNOWN 0xFF
+
+struct UiPeerStatus
+{
+  uint8_t state; // PeerState
+  char name[UI_NAME_LENGTH];
+  int8_t rssi;            // 0 when unknown
+  uint8_t battery;        // percent, UI_BATTERY_UNKNOWN if not reported
+  uint16_t reportRateHz;  // 0 while idle
+};
+
+struct UiStatus
+{
+  uint8_t phase;
+  bool usbReady;
+  uint32_t passkey; // shown while pairing, 0 otherwise
+  uint8_t devicesFound;
+  uint32_t latencyP99Us;
+  UiPeerStatus peers[PROXY_MAX_PEERS];
+};
+
+// Renders a status model on the TFT from its own low-priority task. Setters
+// only write the model and mark the affected screen region dirty, so they
+// are cheap enough for any task, NimBLE callbacks included; the display task
+// redraws the dirty regions through a sprite and pushes each one in a single
+// SPI (DMA) transfer.
+class StatusDisplay
+{
+public:
+  void begin();
+
+  void setPhase(UiPhase phase);
+  void setUsbReady(bool ready);
+  void setPasskey(uint32_t passkey);
+  void setDevicesFound(uint8_t count);
+  void setLatency(uint32_t p99Us);
+  // 0 turns the panel dark and pauses redraws until it is lit again
+  void setBacklight(uint8_t level);
+
+  void setPeerState(uint8_t peer, uint8_t state);
+  void setPeerName(uint8_t peer, const char *name);
+  void setPeerRssi(uint8_t peer, int8_t rssi);
+  void setPeerBattery(uint8_t peer, uint8_t percent);
+  void setPeerRate(uint8_t peer, uint16_t reportRateHz);
+
+  // Consistent copy of the model, for telemetry
+  void snapshot(UiStatus &out);
+  TaskHandle_t task() const { return _task; }
+
+private:
+  enum Region : uint8_t
+  {
+    REGION_HEADER,
+    REGION_PHASE,
+    REGION_FOOTER,
+    REGION_PEERS, // one region per peer from here on
+  };
+
+  static void taskEntry(void *arg);
+  void run();
+  void markDirty(uint32_t regions);
+  void render(uint8_t region, const UiStatus &status);
+  void applyBacklight(uint8_t level);
+
+  UiStatus _status = {};
+  uint32_t _dirty = 0;
+  uint8_t _backlight = UI_BACKLIGHT_FULL;
+  portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+  TaskHandle_t _task = nullptr;
+};
+
+extern StatusDisplay statusDisplay;
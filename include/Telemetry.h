@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+#include "ProxyEvents.h"
+
+// Binary telemetry and command protocol on the CDC serial port, sharing it
+// with the text console. Every frame, in both directions:
+//
+//   0xB5 0x62 | type u8 | length u16 | payload | crc u16
+//
+// Little endian; the CRC is CRC-16/CCITT-FALSE over type, length and
+// payload. The sync bytes never occur in console text, so frames and log
+// lines can be told apart on the same stream.
+#define TELEMETRY_SYNC1 0xB5
+#define TELEMETRY_SYNC2 0x62
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_MAX_COMMAND 16
+
+enum TelemetryFrame : uint8_t
+{
+  // Host -> proxy
+  FRAME_GET_TELEMETRY = 0x01,   // no payload
+  FRAME_STREAM = 0x02,          // u16 interval ms, 0 stops
+  FRAME_RESCAN = 0x10,          // no payload: full scan now
+  FRAME_FORGET_BOND = 0x11,     // u8 peer index, 0xFF for all bonds
+  FRAME_SET_CONN_PARAMS = 0x12, // u8 peer, u16 min, max interval (1.25 ms), latency, timeout (10 ms)
+  FRAME_SET_PROFILE = 0x13,     // u8 connection profile, see ConnTuner.h
+
+  // Proxy -> host
+  FRAME_ACK = 0x80,       // u8 command type, u8 TelemetryStatus
+  FRAME_TELEMETRY = 0x81, // TelemetryHeader + records, see below
+};
+
+enum TelemetryStatus : uint8_t
+{
+  TELEMETRY_OK,
+  TELEMETRY_BAD_LENGTH,
+  TELEMETRY_BAD_ARGUMENT,
+  TELEMETRY_NOT_CONNECTED,
+  TELEMETRY_UNKNOWN_COMMAND = 0xFF,
+};
+
+// FRAME_TELEMETRY payload: the header, then peerCount TelemetryPeer,
+// taskCount TelemetryTask and idCount TelemetryReport records
+struct TelemetryHeader
+{
+  uint8_t version;
+  uint8_t peerCount;
+  uint8_t taskCount;
+  uint8_t idCount;
+  uint32_t uptimeMs;
+  uint32_t heapFree;
+  uint32_t heapMinFree; // low-water mark since boot
+  uint32_t forwarderDropped;
+  uint32_t forwarderFailed;
+  uint32_t forwarderMerged;
+  uint32_t outputWritten;
+  uint32_t outputDeduped;
+  uint32_t latencyP50Us;
+  uint32_t latencyP99Us;
+  uint32_t events[EVENT_TYPE_COUNT]; // loop() events handled, by ProxyEventType
+} __attribute__((packed));
+
+struct TelemetryPeer
+{
+  uint8_t state; // PeerState
+  int8_t rssi;
+  uint8_t battery; // 0xFF unknown
+  uint8_t reserved;
+  uint16_t reportRateHz;
+} __attribute__((packed));
+
+struct TelemetryTask
+{
+  char name[12];
+  uint32_t stackFreeMin; // bytes never used since the task started
+} __attribute__((packed));
+
+struct TelemetryReport
+{
+  uint8_t reportId; // USB report ID
+  uint8_t reserved[3];
+  uint32_t sent;
+  uint32_t failed;
+  uint32_t dropped;
+  uint32_t merged;
+  uint32_t p99Us;
+} __attribute__((packed));
+
+// Runs a decoded command, returns a TelemetryStatus. Implemented by the
+// application, called from loop().
+typedef uint8_t (*TelemetryCommandHandler)(uint8_t type, const uint8_t *payload, size_t length);
+
+class Telemetry
+{
+public:
+  void setCommandHandler(TelemetryCommandHandler handler) { _handler = handler; }
+
+  // Console input, one byte at a time. Returns true if the byte belongs to
+  // a frame and must not reach the text console.
+  bool feed(uint8_t byte);
+
+  // Streams telemetry if enabled; call from loop()
+  void poll();
+
+  void countEvent(uint8_t type);
+
+private:
+  enum ParseState : uint8_t
+  {
+    PARSE_SYNC1,
+    PARSE_SYNC2,
+    PARSE_TYPE,
+    PARSE_LENGTH_LOW,
+    PARSE_LENGTH_HIGH,
+    PARSE_PAYLOAD,
+    PARSE_CRC_LOW,
+    PARSE_CRC_HIGH,
+  };
+
+  void dispatch();
+  void sendTelemetry();
+  void sendFrame(uint8_t type, const uint8_t *payload, size_t length);
+
+  TelemetryCommandHandler _handler = nullptr;
+  ParseState _state = PARSE_SYNC1;
+  uint8_t _type = 0;
+  uint16_t _length = 0;
+  uint16_t _received = 0;
+  uint16_t _crc = 0;
+  uint8_t _payload[TELEMETRY_MAX_COMMAND];
+
+  uint16_t _streamIntervalMs = 0;
+  uint32_t _lastStreamMs = 0;
+  uint32_t _events[EVENT_TYPE_COUNT] = {};
+};
+
+extern Telemetry telemetry;
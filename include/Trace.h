@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Arduino.h>
+#include <atomic>
+#include "ReportRing.h"
+
+// Deferred binary trace. Hot-path code records fixed-size events into a
+// lock-free ring; traceFlush() formats them later from loop(). Enabled with
+// -D PROXY_TRACE=1, otherwise the TRACE_* macros expand to nothing.
+#ifndef PROXY_TRACE
+#define PROXY_TRACE 0
+#endif
+
+#define TRACE_RING_SLOTS 64
+#define TRACE_DATA_BYTES 8
+
+enum TraceEvent : uint8_t
+{
+  TRACE_REPORT_RX,       // report received from BLE
+  TRACE_REPORT_DROP,     // report dropped, ring full
+  TRACE_SEND_FAIL,       // HID.SendReport() failed
+  TRACE_REPORT_UNKNOWN,  // no input report of this ID or length in the report map
+  TRACE_REPORT_FILTERED, // dropped by a transform rule
+  TRACE_REPORT_UNMAPPED, // report ID not exposed over USB
+};
+
+struct TraceRecord
+{
+  uint32_t timestampUs;
+  uint8_t event;
+  uint8_t reportId;
+  uint8_t length;
+  uint8_t data[TRACE_DATA_BYTES];
+};
+
+// One buffer per producing task keeps every ring single-producer
+class TraceBuffer
+{
+public:
+  explicit TraceBuffer(const char *name) : _name(name) {}
+
+  void record(TraceEvent event, uint8_t reportId, const uint8_t *data, size_t length)
+  {
+    TraceRecord *rec = _ring.beginPush();
+    if (!rec)
+    {
+      _overflow.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    rec->timestampUs = micros();
+    rec->event = event;
+    rec->reportId = reportId;
+    rec->length = length;
+    size_t n = length < TRACE_DATA_BYTES ? length : TRACE_DATA_BYTES;
+    if (data && n)
+      memcpy(rec->data, data, n);
+    _ring.commitPush();
+  }
+
+  // Consumer side, call from a low-priority task only
+  void flush(Print &out);
+
+private:
+  const char *_name;
+  SpscRing<TraceRecord, TRACE_RING_SLOTS> _ring;
+  // Counted by the producer, drained by flush()
+  std::atomic<uint32_t> _overflow{0};
+};
+
+#if PROXY_TRACE
+extern TraceBuffer bleTrace;
+extern TraceBuffer usbTrace;
+
+#define TRACE_BLE(event, id, data, len) bleTrace.record(event, id, data, len)
+#define TRACE_USB(event, id, data, len) usbTrace.record(event, id, data, len)
+#else
+#define TRACE_BLE(event, id, data, len) \
+  do                                    \
+  {                                     \
+  } while (0)
+#define TRACE_USB(event, id, data, len) \
+  do                                    \
+  {                                     \
+  } while (0)
+#endif
+
+// Formats all pending trace records to the serial port
+void traceFlush();
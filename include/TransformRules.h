@@ -0,0 +1,38 @@
+#pragma once
+
+// Build-time defaults of the report transforms (see ReportTransform.h).
+// Every value can be overridden with a -D flag in platformio.ini.
+
+// Mouse X/Y scale in 1/256 steps: 256 = unchanged, 128 = half speed
+#ifndef PROXY_MOUSE_SCALE_Q8
+#define PROXY_MOUSE_SCALE_Q8 256
+#endif
+
+#ifndef PROXY_INVERT_X
+#define PROXY_INVERT_X 0
+#endif
+#ifndef PROXY_INVERT_Y
+#define PROXY_INVERT_Y 0
+#endif
+#ifndef PROXY_INVERT_WHEEL
+#define PROXY_INVERT_WHEEL 0
+#endif
+
+// Report kinds that are never forwarded, one bit per HIDReportKind
+// (e.g. 1 << HID_KIND_VENDOR = 32)
+#ifndef PROXY_DROP_KINDS
+#define PROXY_DROP_KINDS 0
+#endif
+
+// Peer report IDs that are never forwarded, each followed by a comma:
+// -D 'PROXY_DROP_REPORT_IDS=4,5,'
+#ifndef PROXY_DROP_REPORT_IDS
+#define PROXY_DROP_REPORT_IDS
+#endif
+
+// Keyboard usages (page 0x07) to replace, as {from, to} pairs each followed
+// by a comma: -D 'PROXY_KEY_REMAP={0x39,0x29},' turns Caps Lock into
+// Escape. Modifiers (0xE0-0xE7) can only be remapped to other modifiers.
+#ifndef PROXY_KEY_REMAP
+#define PROXY_KEY_REMAP
+#endif
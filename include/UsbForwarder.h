@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Arduino.h>
+#include "USBHID.h"
+#include "ForwardPipeline.h"
+#include "ProxyConfig.h"
+
+// Number of slots per peer between the BLE host task and the USB task
+#define REPORT_RING_SLOTS 32
+
+// USB forwarding task stack; core and priority are in ProxyConfig.h
+#define USB_FORWARD_TASK_STACK 4096
+
+// The idle forwarding task still wakes this often to feed the task watchdog
+#define USB_FORWARD_HEARTBEAT_MS 1000
+
+// Decouples BLE notification handling from USB endpoint timing.
+// The NimBLE host task fills ring slots in place and never blocks; a pinned
+// task drains the rings and feeds HID.SendReport(). Each peer has its own
+// statically allocated ring. Reports queued while the endpoint is busy are coalesced per report
+// ID (see ReportCoalescer) instead of being sent one by one. Rings and
+// coalescing live in ForwardPipeline, which also builds natively.
+class UsbForwarder
+{
+public:
+  void begin(USBHID *hid);
+
+  // Producer side, BLE host task only. beginReport() returns the next free
+  // slot of the peer's ring (nullptr if full, counted as a drop); the caller
+  // fills it in place and hands it to the USB task with commitReport().
+  ReportSlot *beginReport(uint8_t peer, uint8_t reportId);
+  void commitReport(uint8_t peer);
+
+  // Descriptor served over USB, used to decide how reports are merged. loop() only.
+  void setReportMap(const uint8_t *descriptor, size_t length);
+
+  // The host (re)enumerated and holds no report state; loop() only
+  void resetHostState();
+
+  uint32_t droppedCount() const { return _dropped; }
+  uint32_t failedCount() const { return _failed; }
+  // Health, see HealthMonitor: SendReport() failures since the last success,
+  // millis() of the last success and of the task's last pass
+  uint32_t consecutiveFailures() const { return _consecutiveFailures; }
+  uint32_t lastSuccessMs() const { return _lastSuccessMs; }
+  uint32_t heartbeatMs() const { return _heartbeatMs; }
+  uint32_t mergedCount() const { return _pipeline.mergedCount(); }
+  const DedupStage &dedup() const { return _pipeline.dedup(); }
+  TaskHandle_t task() const { return _task; }
+
+private:
+  static void taskEntry(void *arg);
+  void run();
+  bool collect();
+  void sendPending();
+  void send(const ReportSlot &report);
+
+  USBHID *_hid = nullptr;
+  TaskHandle_t _task = nullptr;
+  ForwardPipeline<PROXY_MAX_PEERS, REPORT_RING_SLOTS> _pipeline;
+  SemaphoreHandle_t _rulesLock = nullptr;
+  volatile uint32_t _dropped = 0;
+  volatile uint32_t _failed = 0;
+  volatile uint32_t _consecutiveFailures = 0;
+  volatile uint32_t _lastSuccessMs = 0;
+  volatile uint32_t _heartbeatMs = 0;
+};
+
+extern UsbForwarder usbForwarder;
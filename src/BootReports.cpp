@@ -0,0 +1,306 @@
+#include "BootReports.h"
+#include <string.h>
+
+#define PAGE_GENERIC_DESKTOP 0x01
+#define PAGE_KEYBOARD 0x07
+#define PAGE_BUTTON 0x09
+#define PAGE_CONSUMER 0x0C
+#define USAGE_X 0x30
+#define USAGE_Y 0x31
+#define USAGE_WHEEL 0x38
+#define USAGE_AC_PAN 0x238
+#define USAGE_LEFT_CONTROL 0xE0
+#define USAGE_ERROR_ROLLOVER 0x01
+
+#define BOOT_KEY_SLOTS 6
+#define BOOT_MOUSE_BUTTONS 5
+
+// clang-format off
+const uint8_t bootReportDescriptor[] = {
+  // Keyboard, boot layout: modifiers, reserved, six keys; LED output
+  0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, BOOT_REPORT_KEYBOARD,
+  0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+  0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+  0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x75, 0x01, 0x91, 0x02,
+  0x95, 0x01, 0x75, 0x03, 0x91, 0x01,
+  0x05, 0x07, 0x19, 0x00, 0x2A, 0xFF, 0x00, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x95, 0x06, 0x75, 0x08, 0x81, 0x00,
+  0xC0,
+
+  // Mouse, boot layout (buttons, X, Y) followed by wheel and pan
+  0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, BOOT_REPORT_MOUSE, 0x09, 0x01, 0xA1, 0x00,
+  0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+  0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+  0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x09, 0x38, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+  0x05, 0x0C, 0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06,
+  0xC0, 0xC0,
+
+  // Consumer control, one 16-bit usage
+  0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, BOOT_REPORT_CONSUMER,
+  0x19, 0x00, 0x2A, 0xFF, 0x03, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x95, 0x01, 0x75, 0x10, 0x81, 0x00,
+  0xC0,
+};
+// clang-format on
+
+const size_t bootReportDescriptorSize = sizeof(bootReportDescriptor);
+
+// Usage of an element: its bit for variable fields, its value for arrays.
+// Returns 0 when the element carries no usage.
+static uint16_t elementUsage(const HIDField &field, const uint8_t *data, uint16_t element)
+{
+  if (field.flags & HID_FIELD_VARIABLE)
+  {
+    if (!hidReadBits(data, field.bitOffset + element * field.bitSize, field.bitSize))
+      return 0;
+    return field.usageMax > field.usageMin ? field.usageMin + element : field.usageMin;
+  }
+
+  int32_t value = hidReadField(data, field, element);
+  if (value < field.logicalMin || value > field.logicalMax)
+    return 0;
+  return field.usageMin + (value - field.logicalMin);
+}
+
+static int8_t clampAxis(int32_t value)
+{
+  return value < -127 ? -127 : value > 127 ? 127 : value;
+}
+
+void BootTranslator::clear()
+{
+  memset(_route, 0, sizeof(_route));
+  _routeCount = 0;
+  _sourceCount = 0;
+  releaseHeld();
+}
+
+void BootTranslator::applyRelease()
+{
+  if (!_releasePending.exchange(false, std::memory_order_acquire))
+    return;
+  memset(_heldKeyboard, 0, sizeof(_heldKeyboard));
+  _heldButtons = 0;
+  memset(_heldConsumer, 0, sizeof(_heldConsumer));
+  memset(_carry, 0, sizeof(_carry));
+}
+
+int8_t BootTranslator::carryAxis(uint8_t role, int32_t value)
+{
+  int32_t &carry = _carry[role - ROLE_X];
+  int32_t total = value + carry;
+  int8_t sent = clampAxis(total);
+  carry = total - sent;
+  return sent;
+}
+
+void BootTranslator::addSource(uint8_t role, uint8_t element, const HIDField *field)
+{
+  if (_sourceCount < BOOT_MAX_FIELDS)
+    _sources[_sourceCount++] = {role, element, field};
+}
+
+void BootTranslator::compile(const HIDReportMap &map)
+{
+  clear();
+
+  for (size_t i = 0; i < map.reportCount(); i++)
+  {
+    const HIDReportLayout &report = map.report(i);
+    if (report.type != HID_REPORT_INPUT)
+      continue;
+
+    uint8_t target;
+    if (report.kind == HID_KIND_KEYBOARD)
+      target = BOOT_REPORT_KEYBOARD;
+    else if (report.kind == HID_KIND_MOUSE)
+      target = BOOT_REPORT_MOUSE;
+    else if (report.kind == HID_KIND_CONSUMER)
+      target = BOOT_REPORT_CONSUMER;
+    else
+      continue;
+
+    uint8_t first = _sourceCount;
+    const HIDField *fields = map.fields(report);
+    for (uint8_t f = 0; f < report.fieldCount; f++)
+    {
+      const HIDField &field = fields[f];
+      if (field.flags & HID_FIELD_CONSTANT)
+        continue;
+
+      bool relative = (field.flags & HID_FIELD_VARIABLE) && (field.flags & HID_FIELD_RELATIVE);
+      if (target == BOOT_REPORT_KEYBOARD && field.usagePage == PAGE_KEYBOARD)
+        addSource(ROLE_KEYS, 0, &field);
+      else if (target == BOOT_REPORT_MOUSE && field.usagePage == PAGE_BUTTON && (field.flags & HID_FIELD_VARIABLE))
+        addSource(ROLE_BUTTONS, 0, &field);
+      else if (target == BOOT_REPORT_MOUSE && relative && field.usagePage == PAGE_CONSUMER &&
+               field.usageMin == USAGE_AC_PAN)
+        addSource(ROLE_PAN, 0, &field);
+      else if (target == BOOT_REPORT_MOUSE && relative && field.usagePage == PAGE_GENERIC_DESKTOP)
+      {
+        for (uint16_t e = 0; e < field.count; e++)
+        {
+          uint16_t usage = field.usageMax > field.usageMin ? field.usageMin + e : field.usageMin;
+          if (usage == USAGE_X)
+            addSource(ROLE_X, e, &field);
+          else if (usage == USAGE_Y)
+            addSource(ROLE_Y, e, &field);
+          else if (usage == USAGE_WHEEL)
+            addSource(ROLE_WHEEL, e, &field);
+        }
+      }
+      else if (target == BOOT_REPORT_CONSUMER && field.usagePage == PAGE_CONSUMER)
+        addSource(ROLE_CONSUMER, 0, &field);
+    }
+
+    if (_sourceCount > first && _routeCount < HID_MAX_REPORTS)
+    {
+      _routes[_routeCount] = {target, first, (uint8_t)(_sourceCount - first), report.byteLength()};
+      _route[report.id] = ++_routeCount;
+    }
+  }
+}
+
+size_t BootTranslator::translate(uint8_t reportId, const uint8_t *data, size_t length, uint8_t *out)
+{
+  applyRelease();
+
+  uint8_t route = _route[reportId];
+  if (!route)
+    return 0;
+
+  // Shorter payloads would make the field reads run past the data
+  const Route &r = _routes[route - 1];
+  if (length < r.byteLength)
+    return 0;
+
+  uint8_t keyCount = 0;
+  memset(out, 0, BOOT_KEYBOARD_LENGTH);
+  for (uint8_t i = r.first; i < r.first + r.count; i++)
+  {
+    const Source &source = _sources[i];
+    if (r.target == BOOT_REPORT_KEYBOARD)
+      translateKeys(source, data, out, keyCount);
+    else if (r.target == BOOT_REPORT_MOUSE)
+      translateMouse(source, data, out);
+    else
+      translateConsumer(source, data, out);
+  }
+
+  if (r.target == BOOT_REPORT_KEYBOARD)
+  {
+    memcpy(_heldKeyboard, out, BOOT_KEYBOARD_LENGTH);
+    return BOOT_KEYBOARD_LENGTH;
+  }
+  if (r.target == BOOT_REPORT_MOUSE)
+  {
+    _heldButtons = out[0];
+    return BOOT_MOUSE_LENGTH;
+  }
+  memcpy(_heldConsumer, out, BOOT_CONSUMER_LENGTH);
+  return BOOT_CONSUMER_LENGTH;
+}
+
+void BootTranslator::mergeHeld(uint8_t target, uint8_t *out)
+{
+  applyRelease();
+  if (target == BOOT_REPORT_MOUSE)
+  {
+    out[0] |= _heldButtons;
+    return;
+  }
+
+  if (target == BOOT_REPORT_CONSUMER)
+  {
+    // One usage only: another peer's counts while this report has none
+    if (!out[0] && !out[1])
+      memcpy(out, _heldConsumer, BOOT_CONSUMER_LENGTH);
+    return;
+  }
+
+  out[0] |= _heldKeyboard[0];
+  uint8_t *keys = out + 2;
+  const uint8_t *held = _heldKeyboard + 2;
+  if (keys[0] == USAGE_ERROR_ROLLOVER)
+    return;
+  if (held[0] == USAGE_ERROR_ROLLOVER)
+  {
+    memset(keys, USAGE_ERROR_ROLLOVER, BOOT_KEY_SLOTS);
+    return;
+  }
+
+  for (uint8_t i = 0; i < BOOT_KEY_SLOTS && held[i]; i++)
+  {
+    if (memchr(keys, held[i], BOOT_KEY_SLOTS))
+      continue;
+    uint8_t *slot = (uint8_t *)memchr(keys, 0, BOOT_KEY_SLOTS);
+    if (!slot)
+    {
+      memset(keys, USAGE_ERROR_ROLLOVER, BOOT_KEY_SLOTS);
+      return;
+    }
+    *slot = held[i];
+  }
+}
+
+void BootTranslator::translateKeys(const Source &source, const uint8_t *data, uint8_t *out, uint8_t &keyCount) const
+{
+  const HIDField &field = *source.field;
+  for (uint16_t e = 0; e < field.count; e++)
+  {
+    uint16_t usage = elementUsage(field, data, e);
+    if (usage == 0 || usage > 0xFF)
+      continue;
+
+    if (usage >= USAGE_LEFT_CONTROL && usage <= USAGE_LEFT_CONTROL + 7)
+      out[0] |= 1 << (usage - USAGE_LEFT_CONTROL);
+    else if (keyCount < BOOT_KEY_SLOTS && usage > USAGE_ERROR_ROLLOVER + 2)
+      out[2 + keyCount++] = usage;
+    else
+    {
+      // More keys than slots, or the peer reported rollover itself
+      memset(out + 2, USAGE_ERROR_ROLLOVER, BOOT_KEY_SLOTS);
+      keyCount = BOOT_KEY_SLOTS;
+    }
+  }
+}
+
+void BootTranslator::translateMouse(const Source &source, const uint8_t *data, uint8_t *out)
+{
+  const HIDField &field = *source.field;
+  switch (source.role)
+  {
+  case ROLE_BUTTONS:
+    for (uint16_t e = 0; e < field.count; e++)
+    {
+      uint16_t button = elementUsage(field, data, e);
+      if (button >= 1 && button <= BOOT_MOUSE_BUTTONS)
+        out[0] |= 1 << (button - 1);
+    }
+    break;
+  case ROLE_X:
+  case ROLE_Y:
+  case ROLE_WHEEL:
+  case ROLE_PAN:
+    // Boot layout: X, Y, wheel, pan follow the buttons in role order
+    out[1 + source.role - ROLE_X] = carryAxis(source.role, hidReadField(data, field, source.element));
+    break;
+  }
+}
+
+void BootTranslator::translateConsumer(const Source &source, const uint8_t *data, uint8_t *out) const
+{
+  // The synthesized report carries one usage; the first pressed one wins
+  if (out[0] || out[1])
+    return;
+
+  const HIDField &field = *source.field;
+  for (uint16_t e = 0; e < field.count; e++)
+  {
+    uint16_t usage = elementUsage(field, data, e);
+    if (usage)
+    {
+      out[0] = usage & 0xFF;
+      out[1] = usage >> 8;
+      return;
+    }
+  }
+}
@@ -0,0 +1,110 @@
+#include "CompositeDescriptor.h"
+#include "HIDReportMap.h"
+
+#include <string.h>
+
+// Item prefixes with the size bits masked off
+#define ITEM_REPORT_ID 0x84
+#define ITEM_COLLECTION 0xA0
+#define ITEM_END_COLLECTION 0xC0
+#define ITEM_PUSH 0xA4
+#define ITEM_POP 0xB4
+
+static bool usesReportIds(const uint8_t *map, size_t len)
+{
+  size_t pos = 0;
+  while (pos < len)
+  {
+    size_t size = hidItemSize(map + pos, len - pos);
+    if (size == 0)
+      break;
+    if ((map[pos] & 0xFC) == ITEM_REPORT_ID)
+      return true;
+    pos += size;
+  }
+  return false;
+}
+
+bool CompositeDescriptor::put(const uint8_t *bytes, size_t n)
+{
+  if (_size + n > USB_DESCRIPTOR_CAPACITY)
+    return false;
+  memcpy(_data + _size, bytes, n);
+  _size += n;
+  return true;
+}
+
+bool CompositeDescriptor::allocateId(uint8_t *id)
+{
+  if (_nextId > 0xFF)
+    return false;
+  *id = _nextId++;
+  return true;
+}
+
+bool CompositeDescriptor::append(const uint8_t *map, size_t len, uint8_t idMap[256])
+{
+  size_t startSize = _size;
+  uint16_t startId = _nextId;
+  memset(idMap, 0, 256);
+
+  // Maps without report IDs describe a single report ID 0
+  bool hasIds = usesReportIds(map, len);
+  if (!hasIds && !allocateId(&idMap[0]))
+    return false;
+
+  uint8_t push = ITEM_PUSH;
+  bool ok = put(&push, 1);
+  uint8_t depth = 0;
+  size_t pos = 0;
+  while (pos < len && ok)
+  {
+    size_t size = hidItemSize(map + pos, len - pos);
+    if (size == 0)
+    {
+      ok = false;
+      break;
+    }
+
+    const uint8_t *item = map + pos;
+    uint8_t prefix = item[0] & 0xFC;
+
+    if (size > 1 && prefix == ITEM_REPORT_ID)
+    {
+      uint8_t peerId = item[1];
+      if (idMap[peerId] == 0)
+        ok = allocateId(&idMap[peerId]);
+      uint8_t remapped[2] = {0x85, idMap[peerId]};
+      ok = ok && put(remapped, sizeof(remapped));
+    }
+    else
+    {
+      ok = put(item, size);
+
+      if (prefix == ITEM_COLLECTION)
+      {
+        depth++;
+        if (!hasIds && depth == 1)
+        {
+          uint8_t reportId[2] = {0x85, idMap[0]};
+          ok = ok && put(reportId, sizeof(reportId));
+        }
+      }
+      else if (prefix == ITEM_END_COLLECTION && depth > 0)
+        depth--;
+    }
+
+    pos += size;
+  }
+
+  uint8_t pop = ITEM_POP;
+  ok = ok && put(&pop, 1);
+
+  if (!ok)
+  {
+    _size = startSize;
+    _nextId = startId;
+    memset(idMap, 0, 256);
+  }
+  return ok;
+}
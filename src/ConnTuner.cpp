@@ -0,0 +1,118 @@
+#include "ConnTuner.h"
+#include <NimBLEDevice.h>
+#include "Log.h"
+
+ConnTuner connTuner;
+
+// Supervision timeouts cover (1 + latency) * interval * 2 with margin
+static const ConnProfile profiles[CONN_PROFILE_COUNT] = {
+    {"low latency", {6, 6, 0, 100}, {12, 12, 0, 100}, 5000},
+    {"balanced", {6, 6, 0, 150}, {24, 24, 4, 150}, 1000},
+    {"low power", {12, 12, 0, 300}, {40, 40, 8, 300}, 500},
+};
+
+void ConnTuner::setProfile(uint8_t id)
+{
+  if (id >= CONN_PROFILE_COUNT)
+    return;
+
+  _profile = id;
+  LOGI("Connection profile: %s\n", profiles[id].name);
+}
+
+const ConnProfile &ConnTuner::profile() const
+{
+  return profiles[_profile < CONN_PROFILE_COUNT ? _profile : CONN_PROFILE_BALANCED];
+}
+
+bool ConnTuner::onReport(uint8_t peer)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return false;
+
+  PeerRate &rate = _peers[peer];
+  const ConnProfile &prof = profile();
+  uint32_t now = micros();
+  uint32_t gap = now - rate.lastReportUs;
+  rate.lastReportUs = now;
+
+  // A gap longer than the idle time starts a new burst
+  if (gap > prof.idleAfterMs * 1000)
+    rate.intervalUs = prof.idleAfterMs * 1000;
+  else
+    rate.intervalUs = rate.intervalUs - rate.intervalUs / 8 + gap / 8;
+
+  // Activity is a burst of reports, not an average that first has to
+  // forget the quiet time
+  if (now - rate.burstStartUs > CONN_BURST_WINDOW_MS * 1000)
+  {
+    rate.burstStartUs = now;
+    rate.burstReports = 0;
+  }
+  if (rate.burstReports < CONN_BURST_REPORTS)
+    rate.burstReports++;
+
+  if (!rate.idle || rate.activating || rate.burstReports < CONN_BURST_REPORTS)
+    return false;
+
+  rate.activating = true;
+  return true;
+}
+
+void ConnTuner::activationDropped(uint8_t peer)
+{
+  if (peer < PROXY_MAX_PEERS)
+    _peers[peer].activating = false;
+}
+
+void ConnTuner::reset(uint8_t peer)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  // Links are opened with the active parameters
+  PeerRate &rate = _peers[peer];
+  rate.lastReportUs = micros();
+  rate.intervalUs = profile().idleAfterMs * 1000;
+  rate.burstStartUs = rate.lastReportUs;
+  rate.burstReports = 0;
+  rate.idle = false;
+  rate.activating = false;
+}
+
+void ConnTuner::activate(uint8_t peer, NimBLEClient *client)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  PeerRate &rate = _peers[peer];
+  if (rate.idle)
+    apply(peer, client, profile().active);
+  rate.idle = false;
+  rate.activating = false;
+}
+
+void ConnTuner::update(uint8_t peer, NimBLEClient *client)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  PeerRate &rate = _peers[peer];
+  if (rate.idle || micros() - rate.lastReportUs < profile().idleAfterMs * 1000)
+    return;
+
+  apply(peer, client, profile().idle);
+  rate.idle = true;
+}
+
+void ConnTuner::apply(uint8_t peer, NimBLEClient *client, const ConnParams &params)
+{
+  if (!client || !client->isConnected())
+    return;
+
+  LOGD("Peer %d: %s connection interval %d.%02d ms, latency %d\n", peer,
+       &params == &profile().idle ? "idle" : "active",
+       params.maxInterval * 125 / 100, params.maxInterval * 125 % 100, params.latency);
+
+  client->updateConnParams(params.minInterval, params.maxInterval, params.latency, params.timeout);
+}
@@ -0,0 +1,99 @@
+#include "Console.h"
+#include "LatencyStats.h"
+#include "UsbForwarder.h"
+#include "LoadGen.h"
+#include "OutputRelay.h"
+#include "DeviceInfo.h"
+#include "Telemetry.h"
+#include "PairingStats.h"
+#include "PowerManager.h"
+#include "HealthMonitor.h"
+
+static char line[CONSOLE_LINE_LENGTH];
+static size_t lineLength = 0;
+
+static void printHelp()
+{
+  Serial.println("Commands:");
+  Serial.println("  stats        latency percentiles and drop counters per report ID, pairing times");
+  Serial.println("  stats hist   same, with the total latency histogram");
+  Serial.println("  stats reset  clear all counters");
+  Serial.println("  info         cached name, manufacturer, PnP ID and battery of each peer");
+  Serial.println("  health       fault state of each peer and USB, recovery step counts and times");
+#if PROXY_SEQ_CHECK
+  Serial.println("  seq          load generator loss and reordering per peer and report ID");
+  Serial.println("  seq reset    clear the sequence counters");
+#endif
+}
+
+static void printStats(bool histogram)
+{
+  Serial.printf("Forwarder: %u dropped, %u failed, %u merged\n", usbForwarder.droppedCount(),
+                usbForwarder.failedCount(), usbForwarder.mergedCount());
+  Serial.printf("Output relay: %u written, %u deduplicated\n", outputRelay.writtenCount(),
+                outputRelay.dedupedCount());
+  const DedupStage &dedup = usbForwarder.dedup();
+  Serial.printf("Deduplicated: %u identical reports not sent\n", dedup.suppressedCount());
+  for (size_t i = 0; i < dedup.idCount(); i++)
+    Serial.printf("  id %3d: %u\n", dedup.reportId(i), dedup.suppressedCount(i));
+  pairingStats.print(Serial);
+  Serial.printf("Power: %s, woken %u times\n", powerManager.state() == POWER_IDLE ? "idle" : "active",
+                powerManager.wakeCount());
+#if PROXY_LATENCY_STATS
+  latencyStats.print(Serial, histogram);
+#else
+  Serial.println("Latency stats disabled (PROXY_LATENCY_STATS=0)");
+#endif
+}
+
+static void runCommand(const char *command)
+{
+  if (strcmp(command, "stats") == 0)
+    printStats(false);
+  else if (strcmp(command, "stats hist") == 0)
+    printStats(true);
+  else if (strcmp(command, "stats reset") == 0)
+  {
+#if PROXY_LATENCY_STATS
+    latencyStats.reset();
+#endif
+    pairingStats.reset();
+    Serial.println("Stats cleared");
+  }
+#if PROXY_SEQ_CHECK
+  else if (strcmp(command, "seq") == 0)
+    seqCheck.print(Serial);
+  else if (strcmp(command, "seq reset") == 0)
+  {
+    seqCheck.reset();
+    Serial.println("Sequence counters cleared");
+  }
+#endif
+  else if (strcmp(command, "info") == 0)
+    deviceInfo.print(Serial);
+  else if (strcmp(command, "health") == 0)
+    healthMonitor.print(Serial);
+  else if (strcmp(command, "help") == 0)
+    printHelp();
+  else if (command[0])
+    Serial.printf("Unknown command: %s\n", command);
+}
+
+void consolePoll()
+{
+  while (Serial.available())
+  {
+    char c = Serial.read();
+    // Binary frames share the port with the text console
+    if (telemetry.feed(c))
+      continue;
+    if (c == '\r' || c == '\n')
+    {
+      line[lineLength] = '\0';
+      runCommand(line);
+      lineLength = 0;
+    }
+    else if (lineLength < CONSOLE_LINE_LENGTH - 1)
+      line[lineLength++] = c;
+  }
+}
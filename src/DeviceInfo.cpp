@@ -0,0 +1,194 @@
+#include "DeviceInfo.h"
+#include "StatusDisplay.h"
+#include "Log.h"
+
+DeviceInfoPoller deviceInfo;
+
+static NimBLEUUID GAP_SERVICE_UUID((uint16_t)0x1800);
+static NimBLEUUID DEVICE_NAME_UUID((uint16_t)0x2A00);
+static NimBLEUUID DEVICE_INFO_UUID((uint16_t)0x180A);
+static NimBLEUUID MANUFACTURER_NAME_UUID((uint16_t)0x2A29);
+static NimBLEUUID PNP_ID_UUID((uint16_t)0x2A50);
+static NimBLEUUID HID_SERVICE_UUID((uint16_t)0x1812);
+static NimBLEUUID HID_INFO_UUID((uint16_t)0x2A4A);
+static NimBLEUUID BATTERY_SERVICE_UUID((uint16_t)0x180F);
+static NimBLEUUID BATTERY_LEVEL_UUID((uint16_t)0x2A19);
+
+// Reads a characteristic once; an empty value if it is missing or unreadable
+static NimBLEAttValue readCharacteristic(NimBLEClient *client, const NimBLEUUID &service,
+                                         const NimBLEUUID &characteristic)
+{
+  NimBLERemoteService *svc = client->getService(service);
+  NimBLERemoteCharacteristic *chr = svc ? svc->getCharacteristic(characteristic) : nullptr;
+  if (!chr || !chr->canRead())
+    return NimBLEAttValue();
+  return chr->readValue();
+}
+
+static void copyText(char *dst, const NimBLEAttValue &value)
+{
+  size_t n = value.size() < INFO_TEXT_LENGTH - 1 ? value.size() : INFO_TEXT_LENGTH - 1;
+  memcpy(dst, value.data(), n);
+  dst[n] = '\0';
+}
+
+void DeviceInfoPoller::start(uint8_t peer, NimBLEClient *client, const NimBLEAddress &identity,
+                             bool batteryNotifies)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  DeviceInfo &info = _info[peer];
+  if (info.identity != identity)
+  {
+    info = DeviceInfo();
+    info.identity = identity;
+  }
+  info.battery = INFO_BATTERY_UNKNOWN;
+  info.known &= ~(1 << QUERY_BATTERY);
+
+  Slot &slot = _slots[peer];
+  slot.client = client;
+  slot.dueMs = millis() + INFO_START_DELAY_MS;
+  slot.pending = ((1 << QUERY_COUNT) - 1) & ~info.known;
+  slot.pollBattery = !batteryNotifies;
+  slot.batteryDueMs = slot.dueMs + INFO_BATTERY_POLL_MS;
+
+  // A name read before is shown right away
+  if (info.known & (1 << QUERY_NAME))
+    statusDisplay.setPeerName(peer, info.name);
+}
+
+void DeviceInfoPoller::stop(uint8_t peer)
+{
+  if (peer < PROXY_MAX_PEERS)
+    _slots[peer] = {};
+}
+
+void DeviceInfoPoller::setBattery(uint8_t peer, uint8_t percent)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+  _info[peer].battery = percent;
+  _info[peer].known |= 1 << QUERY_BATTERY;
+}
+
+void DeviceInfoPoller::poll()
+{
+  uint32_t now = millis();
+  if (now - _lastQueryMs < INFO_QUERY_SPACING_MS)
+    return;
+
+  for (uint8_t peer = 0; peer < PROXY_MAX_PEERS; peer++)
+  {
+    Slot &slot = _slots[peer];
+    if (!slot.client || (int32_t)(now - slot.dueMs) < 0)
+      continue;
+
+    if (slot.pollBattery && (int32_t)(now - slot.batteryDueMs) >= 0)
+    {
+      slot.pending |= 1 << QUERY_BATTERY;
+      slot.batteryDueMs = now + INFO_BATTERY_POLL_MS;
+    }
+    if (!slot.pending)
+      continue;
+
+    // One read per call, lowest query first
+    uint8_t which = __builtin_ctz(slot.pending);
+    slot.pending &= ~(1 << which);
+    if (slot.client->isConnected())
+      query(peer, which);
+    _lastQueryMs = millis();
+    return;
+  }
+}
+
+void DeviceInfoPoller::query(uint8_t peer, uint8_t which)
+{
+  NimBLEClient *client = _slots[peer].client;
+  DeviceInfo &info = _info[peer];
+
+  switch (which)
+  {
+  case QUERY_BATTERY:
+  {
+    NimBLEAttValue value = readCharacteristic(client, BATTERY_SERVICE_UUID, BATTERY_LEVEL_UUID);
+    if (value.size() < 1)
+      return;
+    info.battery = value.data()[0];
+    statusDisplay.setPeerBattery(peer, info.battery);
+    LOGD("Peer %d battery: %d%%\n", peer + 1, info.battery);
+    break;
+  }
+
+  case QUERY_NAME:
+  {
+    NimBLEAttValue value = readCharacteristic(client, GAP_SERVICE_UUID, DEVICE_NAME_UUID);
+    if (value.size() == 0)
+      return;
+    copyText(info.name, value);
+    statusDisplay.setPeerName(peer, info.name);
+    LOGI("Peer %d name: %s\n", peer + 1, info.name);
+    break;
+  }
+
+  case QUERY_MANUFACTURER:
+  {
+    NimBLEAttValue value = readCharacteristic(client, DEVICE_INFO_UUID, MANUFACTURER_NAME_UUID);
+    if (value.size() == 0)
+      return;
+    copyText(info.manufacturer, value);
+    LOGI("Peer %d manufacturer: %s\n", peer + 1, info.manufacturer);
+    break;
+  }
+
+  case QUERY_PNP_ID:
+  {
+    NimBLEAttValue value = readCharacteristic(client, DEVICE_INFO_UUID, PNP_ID_UUID);
+    if (value.size() < 7)
+      return;
+    const uint8_t *data = value.data();
+    info.vendorId = data[1] | (data[2] << 8);
+    info.productId = data[3] | (data[4] << 8);
+    info.productVersion = data[5] | (data[6] << 8);
+    LOGI("Peer %d VID: 0x%04X, PID: 0x%04X, Version: 0x%04X\n", peer + 1, info.vendorId,
+         info.productId, info.productVersion);
+    break;
+  }
+
+  case QUERY_HID_INFO:
+  {
+    NimBLEAttValue value = readCharacteristic(client, HID_SERVICE_UUID, HID_INFO_UUID);
+    if (value.size() < 4)
+      return;
+    const uint8_t *data = value.data();
+    info.hidVersion = data[0] | (data[1] << 8);
+    info.country = data[2];
+    info.hidFlags = data[3];
+    LOGI("Peer %d HID Version: %x.%02x, Country: %d, Flags: 0x%02X\n", peer + 1,
+         info.hidVersion >> 8, info.hidVersion & 0xFF, info.country, info.hidFlags);
+    break;
+  }
+  }
+
+  info.known |= 1 << which;
+}
+
+void DeviceInfoPoller::print(Print &out) const
+{
+  for (uint8_t peer = 0; peer < PROXY_MAX_PEERS; peer++)
+  {
+    const DeviceInfo &info = _info[peer];
+    if (!info.known)
+      continue;
+
+    out.printf("Peer %d (%s): %s", peer + 1, info.identity.toString().c_str(), info.name[0] ? info.name : "-");
+    if (info.manufacturer[0])
+      out.printf(", %s", info.manufacturer);
+    if (info.known & (1 << QUERY_PNP_ID))
+      out.printf(", VID 0x%04X PID 0x%04X v0x%04X", info.vendorId, info.productId, info.productVersion);
+    if (info.battery != INFO_BATTERY_UNKNOWN)
+      out.printf(", battery %d%%", info.battery);
+    out.println();
+  }
+}
@@ -0,0 +1,508 @@
+#include "HIDReportMap.h"
+
+#include <string.h>
+
+// Item types and tags from the HID 1.11 specification, section 6.2.2
+#define HID_ITEM_TYPE_MAIN 0
+#define HID_ITEM_TYPE_GLOBAL 1
+#define HID_ITEM_TYPE_LOCAL 2
+#define HID_ITEM_LONG 0xFE
+
+#define HID_MAIN_INPUT 0x8
+#define HID_MAIN_OUTPUT 0x9
+#define HID_MAIN_COLLECTION 0xA
+#define HID_MAIN_FEATURE 0xB
+#define HID_MAIN_END_COLLECTION 0xC
+
+#define HID_GLOBAL_USAGE_PAGE 0x0
+#define HID_GLOBAL_LOGICAL_MIN 0x1
+#define HID_GLOBAL_LOGICAL_MAX 0x2
+#define HID_GLOBAL_REPORT_SIZE 0x7
+#define HID_GLOBAL_REPORT_ID 0x8
+#define HID_GLOBAL_REPORT_COUNT 0x9
+#define HID_GLOBAL_PUSH 0xA
+#define HID_GLOBAL_POP 0xB
+
+#define HID_LOCAL_USAGE 0x0
+#define HID_LOCAL_USAGE_MIN 0x1
+#define HID_LOCAL_USAGE_MAX 0x2
+
+#define HID_COLLECTION_APPLICATION 0x01
+
+#define MAX_LOCAL_USAGES 16
+#define MAX_GLOBAL_STACK 4
+
+namespace
+{
+  struct GlobalState
+  {
+    uint16_t usagePage;
+    uint32_t logicalMinRaw;
+    uint32_t logicalMaxRaw;
+    uint8_t logicalMinSize;
+    uint8_t logicalMaxSize;
+    uint8_t reportSize;
+    uint8_t reportId;
+    uint16_t reportCount;
+  };
+
+  struct LocalState
+  {
+    uint32_t usages[MAX_LOCAL_USAGES]; // extended usages, page in the high half
+    uint8_t usageCount;
+    uint32_t usageMin;
+    uint32_t usageMax;
+    bool hasMin;
+    bool hasMax;
+  };
+
+  int32_t signExtend(uint32_t value, uint8_t size)
+  {
+    switch (size)
+    {
+    case 1:
+      return (int8_t)value;
+    case 2:
+      return (int16_t)value;
+    default:
+      return (int32_t)value;
+    }
+  }
+
+  uint32_t extendUsage(uint32_t usage, uint8_t size, uint16_t page)
+  {
+    // Four-byte usages carry their own page
+    return size == 4 ? usage : ((uint32_t)page << 16) | (usage & 0xFFFF);
+  }
+
+  uint8_t kindFromUsage(uint32_t usage)
+  {
+    uint16_t page = usage >> 16;
+    uint16_t id = usage & 0xFFFF;
+
+    if (page == 0x01)
+    {
+      switch (id)
+      {
+      case 0x01:
+      case 0x02:
+        return HID_KIND_MOUSE;
+      case 0x04:
+      case 0x05:
+        return HID_KIND_GAMEPAD;
+      case 0x06:
+      case 0x07:
+        return HID_KIND_KEYBOARD;
+      case 0x80:
+        return HID_KIND_CONSUMER;
+      }
+    }
+    else if (page == 0x0C)
+      return HID_KIND_CONSUMER;
+    else if (page >= 0xFF00)
+      return HID_KIND_VENDOR;
+    return HID_KIND_UNKNOWN;
+  }
+}
+
+void HIDReportMap::clear()
+{
+  _reportCount = 0;
+  _fieldCount = 0;
+  _usesReportIds = false;
+  memset(_index, NO_REPORT, sizeof(_index));
+  memset(_inputByLength, NO_REPORT, sizeof(_inputByLength));
+  memset(_ambiguousLengths, 0, sizeof(_ambiguousLengths));
+}
+
+HIDReportLayout *HIDReportMap::findOrAddReport(uint8_t type, uint8_t reportId, uint8_t kind)
+{
+  uint8_t idx = _index[type][reportId];
+  if (idx != NO_REPORT)
+    return &_reports[idx];
+
+  if (_reportCount >= HID_MAX_REPORTS)
+    return nullptr;
+
+  HIDReportLayout &report = _reports[_reportCount];
+  report.id = reportId;
+  report.type = type;
+  report.kind = kind;
+  report.fieldCount = 0;
+  report.bitLength = 0;
+  report.firstField = 0;
+  _index[type][reportId] = _reportCount;
+  return &_reports[_reportCount++];
+}
+
+bool HIDReportMap::addField(HIDReportLayout *report, const HIDField &field)
+{
+  if (_fieldCount >= HID_MAX_FIELDS)
+    return false;
+
+  _fields[_fieldCount] = field;
+  _fieldOwner[_fieldCount] = report - _reports;
+  _fieldCount++;
+  return true;
+}
+
+bool HIDReportMap::parse(const uint8_t *data, size_t len)
+{
+  clear();
+
+  GlobalState global = {};
+  GlobalState stack[MAX_GLOBAL_STACK];
+  uint8_t stackDepth = 0;
+  LocalState local = {};
+  uint8_t collectionDepth = 0;
+  uint8_t currentKind = HID_KIND_UNKNOWN;
+  bool ok = true;
+
+  size_t pos = 0;
+  while (pos < len && ok)
+  {
+    uint8_t prefix = data[pos];
+
+    if (prefix == HID_ITEM_LONG)
+    {
+      // Long items are reserved and carry nothing we use; skip them
+      if (pos + 2 >= len)
+      {
+        ok = false;
+        break;
+      }
+      pos += 3 + data[pos + 1];
+      continue;
+    }
+
+    uint8_t size = prefix & 0x03;
+    if (size == 3)
+      size = 4;
+    uint8_t type = (prefix >> 2) & 0x03;
+    uint8_t tag = prefix >> 4;
+
+    if (pos + 1 + size > len)
+    {
+      ok = false;
+      break;
+    }
+
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < size; i++)
+      value |= (uint32_t)data[pos + 1 + i] << (8 * i);
+    pos += 1 + size;
+
+    if (type == HID_ITEM_TYPE_MAIN)
+    {
+      switch (tag)
+      {
+      case HID_MAIN_INPUT:
+      case HID_MAIN_OUTPUT:
+      case HID_MAIN_FEATURE:
+      {
+        uint8_t reportType = tag == HID_MAIN_INPUT    ? HID_REPORT_INPUT
+                             : tag == HID_MAIN_OUTPUT ? HID_REPORT_OUTPUT
+                                                      : HID_REPORT_FEATURE;
+        HIDReportLayout *report = findOrAddReport(reportType, global.reportId, currentKind);
+        if (!report)
+        {
+          ok = false;
+          break;
+        }
+
+        HIDField field = {};
+        field.bitOffset = report->bitLength;
+        field.bitSize = global.reportSize;
+        field.flags = value & (HID_FIELD_CONSTANT | HID_FIELD_VARIABLE | HID_FIELD_RELATIVE);
+        field.usagePage = global.usagePage;
+        field.logicalMin = signExtend(global.logicalMinRaw, global.logicalMinSize);
+        field.logicalMax = field.logicalMin < 0 ? signExtend(global.logicalMaxRaw, global.logicalMaxSize)
+                                                : (int32_t)global.logicalMaxRaw;
+
+        uint32_t totalBits = (uint32_t)global.reportSize * global.reportCount;
+
+        if (!(field.flags & HID_FIELD_CONSTANT) && global.reportSize == 0)
+        {
+          // A data field without bits has no valid encoding
+          ok = false;
+          break;
+        }
+
+        if ((field.flags & HID_FIELD_CONSTANT) || global.reportSize > 32)
+        {
+          // Padding, only advances the bit offset. Fields wider than the bit
+          // helpers handle are kept opaque the same way.
+        }
+        else if ((field.flags & HID_FIELD_VARIABLE) && local.usageCount > 0)
+        {
+          // One field per listed usage; the last usage covers any remaining elements
+          uint16_t element = 0;
+          while (element < global.reportCount && ok)
+          {
+            uint8_t u = element < local.usageCount ? element : local.usageCount - 1;
+            uint16_t count = element < local.usageCount - 1 ? 1 : global.reportCount - element;
+            HIDField f = field;
+            f.bitOffset = report->bitLength + element * global.reportSize;
+            f.count = count;
+            f.usagePage = local.usages[u] >> 16;
+            f.usageMin = f.usageMax = local.usages[u] & 0xFFFF;
+            ok = addField(report, f);
+            element += count;
+          }
+        }
+        else
+        {
+          // Usage range (bitmaps) or array
+          field.count = global.reportCount;
+          if (local.hasMin || local.hasMax)
+          {
+            field.usagePage = local.usageMin >> 16;
+            field.usageMin = local.usageMin & 0xFFFF;
+            field.usageMax = local.usageMax & 0xFFFF;
+          }
+          else if (local.usageCount > 0)
+          {
+            field.usagePage = local.usages[0] >> 16;
+            field.usageMin = local.usages[0] & 0xFFFF;
+            field.usageMax = local.usages[local.usageCount - 1] & 0xFFFF;
+          }
+          ok = addField(report, field);
+        }
+
+        report->bitLength += totalBits;
+        break;
+      }
+
+      case HID_MAIN_COLLECTION:
+        collectionDepth++;
+        if (collectionDepth == 1 && value == HID_COLLECTION_APPLICATION)
+        {
+          uint32_t usage = local.usageCount > 0 ? local.usages[0]
+                           : local.hasMin       ? local.usageMin
+                                                : 0;
+          currentKind = kindFromUsage(usage);
+        }
+        break;
+
+      case HID_MAIN_END_COLLECTION:
+        if (collectionDepth > 0)
+          collectionDepth--;
+        if (collectionDepth == 0)
+          currentKind = HID_KIND_UNKNOWN;
+        break;
+      }
+
+      // Local items only apply to the next main item
+      local = {};
+    }
+    else if (type == HID_ITEM_TYPE_GLOBAL)
+    {
+      switch (tag)
+      {
+      case HID_GLOBAL_USAGE_PAGE:
+        global.usagePage = value;
+        break;
+      case HID_GLOBAL_LOGICAL_MIN:
+        global.logicalMinRaw = value;
+        global.logicalMinSize = size;
+        break;
+      case HID_GLOBAL_LOGICAL_MAX:
+        global.logicalMaxRaw = value;
+        global.logicalMaxSize = size;
+        break;
+      case HID_GLOBAL_REPORT_SIZE:
+        if (value > 0xFF)
+          ok = false;
+        global.reportSize = value;
+        break;
+      case HID_GLOBAL_REPORT_ID:
+        if (value == 0 || value > 0xFF)
+          ok = false;
+        global.reportId = value;
+        _usesReportIds = true;
+        break;
+      case HID_GLOBAL_REPORT_COUNT:
+        global.reportCount = value;
+        break;
+      case HID_GLOBAL_PUSH:
+        if (stackDepth >= MAX_GLOBAL_STACK)
+          ok = false;
+        else
+          stack[stackDepth++] = global;
+        break;
+      case HID_GLOBAL_POP:
+        if (stackDepth == 0)
+          ok = false;
+        else
+          global = stack[--stackDepth];
+        break;
+      }
+    }
+    else if (type == HID_ITEM_TYPE_LOCAL)
+    {
+      switch (tag)
+      {
+      case HID_LOCAL_USAGE:
+        if (local.usageCount < MAX_LOCAL_USAGES)
+          local.usages[local.usageCount++] = extendUsage(value, size, global.usagePage);
+        break;
+      case HID_LOCAL_USAGE_MIN:
+        local.usageMin = extendUsage(value, size, global.usagePage);
+        local.hasMin = true;
+        break;
+      case HID_LOCAL_USAGE_MAX:
+        local.usageMax = extendUsage(value, size, global.usagePage);
+        local.hasMax = true;
+        break;
+      }
+    }
+  }
+
+  finish();
+  return ok && collectionDepth == 0;
+}
+
+void HIDReportMap::finish()
+{
+  // Group fields by report so each report owns a contiguous slice
+  for (uint16_t i = 1; i < _fieldCount; i++)
+  {
+    HIDField field = _fields[i];
+    uint8_t owner = _fieldOwner[i];
+    uint16_t j = i;
+    while (j > 0 && _fieldOwner[j - 1] > owner)
+    {
+      _fields[j] = _fields[j - 1];
+      _fieldOwner[j] = _fieldOwner[j - 1];
+      j--;
+    }
+    _fields[j] = field;
+    _fieldOwner[j] = owner;
+  }
+
+  for (uint16_t i = 0; i < _fieldCount; i++)
+  {
+    HIDReportLayout &report = _reports[_fieldOwner[i]];
+    if (report.fieldCount == 0)
+      report.firstField = i;
+    report.fieldCount++;
+  }
+
+  for (uint8_t i = 0; i < _reportCount; i++)
+  {
+    const HIDReportLayout &report = _reports[i];
+    uint16_t bytes = report.byteLength();
+    if (report.type != HID_REPORT_INPUT || bytes > HID_MAX_REPORT_BYTES)
+      continue;
+
+    if (_inputByLength[bytes] == NO_REPORT)
+      _inputByLength[bytes] = i;
+    else
+      _ambiguousLengths[bytes / 8] |= 1 << (bytes % 8);
+  }
+}
+
+const HIDField *HIDReportMap::findField(const HIDReportLayout &report, uint16_t usagePage, uint16_t usage) const
+{
+  const HIDField *f = fields(report);
+  for (uint8_t i = 0; i < report.fieldCount; i++)
+  {
+    if (f[i].usagePage == usagePage && usage >= f[i].usageMin && usage <= f[i].usageMax)
+      return &f[i];
+  }
+  return nullptr;
+}
+
+const char *HIDReportMap::kindName(uint8_t kind)
+{
+  switch (kind)
+  {
+  case HID_KIND_KEYBOARD:
+    return "keyboard";
+  case HID_KIND_MOUSE:
+    return "mouse";
+  case HID_KIND_CONSUMER:
+    return "consumer";
+  case HID_KIND_GAMEPAD:
+    return "gamepad";
+  case HID_KIND_VENDOR:
+    return "vendor";
+  default:
+    return "unknown";
+  }
+}
+
+const char *HIDReportMap::typeName(uint8_t type)
+{
+  switch (type)
+  {
+  case HID_REPORT_INPUT:
+    return "input";
+  case HID_REPORT_OUTPUT:
+    return "output";
+  default:
+    return "feature";
+  }
+}
+
+size_t hidItemSize(const uint8_t *item, size_t remaining)
+{
+  if (remaining == 0)
+    return 0;
+
+  size_t size;
+  if (item[0] == HID_ITEM_LONG)
+    size = remaining >= 2 ? 3 + item[1] : remaining + 1;
+  else
+    size = 1 + ((item[0] & 0x03) == 3 ? 4 : (item[0] & 0x03));
+
+  return size <= remaining ? size : 0;
+}
+
+uint32_t hidReadBits(const uint8_t *data, uint16_t bitOffset, uint8_t bitSize)
+{
+  uint32_t value = 0;
+  uint8_t got = 0;
+  while (got < bitSize)
+  {
+    uint8_t shift = bitOffset & 7;
+    uint8_t take = 8 - shift;
+    if (take > bitSize - got)
+      take = bitSize - got;
+    uint32_t bits = (data[bitOffset >> 3] >> shift) & ((1u << take) - 1);
+    value |= bits << got;
+    got += take;
+    bitOffset += take;
+  }
+  return value;
+}
+
+int32_t hidReadField(const uint8_t *data, const HIDField &field, uint16_t element)
+{
+  uint32_t raw = hidReadBits(data, field.bitOffset + element * field.bitSize, field.bitSize);
+  if (field.logicalMin < 0 && field.bitSize < 32 && (raw & (1u << (field.bitSize - 1))))
+    raw |= ~0u << field.bitSize;
+  return (int32_t)raw;
+}
+
+void hidWriteBits(uint8_t *data, uint16_t bitOffset, uint8_t bitSize, uint32_t value)
+{
+  uint8_t done = 0;
+  while (done < bitSize)
+  {
+    uint8_t shift = bitOffset & 7;
+    uint8_t take = 8 - shift;
+    if (take > bitSize - done)
+      take = bitSize - done;
+    uint8_t mask = ((1u << take) - 1) << shift;
+    uint8_t &byte = data[bitOffset >> 3];
+    byte = (byte & ~mask) | (((value >> done) << shift) & mask);
+    done += take;
+    bitOffset += take;
+  }
+}
+
+void hidWriteField(uint8_t *data, const HIDField &field, uint16_t element, int32_t value)
+{
+  hidWriteBits(data, field.bitOffset + element * field.bitSize, field.bitSize, (uint32_t)value);
+}
@@ -0,0 +1,252 @@
+#include "HealthMonitor.h"
+#include "UsbForwarder.h"
+#include "Log.h"
+#include "tusb.h"
+
+HealthMonitor healthMonitor;
+
+#define HEALTH_RTC_MAGIC 0x48454C54
+
+// Survives esp_restart(), not a power cycle
+struct HealthRtc
+{
+  uint32_t magic;
+  uint32_t reboots;
+  bool rebooting; // set right before a recovery reboot
+};
+static RTC_NOINIT_ATTR HealthRtc rtc;
+
+static const char *stepName(uint8_t step)
+{
+  switch (step)
+  {
+  case RECOVER_RESUBSCRIBE:
+    return "resubscribe";
+  case RECOVER_RECONNECT:
+    return "reconnect";
+  case RECOVER_USB_REINIT:
+    return "USB re-init";
+  default:
+    return "reboot";
+  }
+}
+
+void HealthMonitor::begin(RecoveryAction action)
+{
+  _action = action;
+
+  if (rtc.magic != HEALTH_RTC_MAGIC)
+    rtc = {HEALTH_RTC_MAGIC, 0, false};
+  if (rtc.rebooting)
+  {
+    LOGW("Restarted by fault recovery (%u recovery reboots since power-on)\n", rtc.reboots);
+    _steps[RECOVER_REBOOT].recovered++;
+    rtc.rebooting = false;
+  }
+}
+
+void HealthMonitor::onUnboundNotify(uint8_t peer)
+{
+  if (peer < PROXY_MAX_PEERS)
+    _unbound[peer]++;
+}
+
+void HealthMonitor::onLinkProbe(uint8_t peer, bool ok)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+  if (ok)
+    _probeFailures[peer] = 0;
+  else if (_probeFailures[peer] < 0xFF)
+    _probeFailures[peer]++;
+}
+
+void HealthMonitor::onPeerReady(uint8_t peer)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+  _linked[peer] = true;
+  _probeFailures[peer] = 0;
+  _unbound[peer] = 0;
+}
+
+void HealthMonitor::onPeerDisconnected(uint8_t peer)
+{
+  if (peer < PROXY_MAX_PEERS)
+    _linked[peer] = false;
+}
+
+void HealthMonitor::setUsbMounted(bool mounted)
+{
+  _usbMounted = mounted;
+}
+
+uint32_t HealthMonitor::stepTimeout(uint8_t step)
+{
+  switch (step)
+  {
+  case RECOVER_RESUBSCRIBE:
+    return HEALTH_RESUBSCRIBE_MS;
+  case RECOVER_RECONNECT:
+    return HEALTH_RECONNECT_MS;
+  case RECOVER_USB_REINIT:
+    return HEALTH_USB_REINIT_MS;
+  default:
+    return 0;
+  }
+}
+
+void HealthMonitor::poll()
+{
+  uint32_t now = millis();
+  if (now - _lastCheckMs < HEALTH_CHECK_INTERVAL)
+    return;
+  _lastCheckMs = now;
+
+  for (uint8_t i = 0; i < PROXY_MAX_PEERS; i++)
+    checkPeer(i);
+  checkUsb();
+}
+
+void HealthMonitor::checkPeer(uint8_t peer)
+{
+  Domain &domain = _peers[peer];
+  bool probeFault = _probeFailures[peer] >= HEALTH_PROBE_FAILURES;
+  bool unboundFault = _unbound[peer] >= HEALTH_UNBOUND_NOTIFIES;
+  _unbound[peer] = 0;
+
+  if (!domain.faulted)
+  {
+    // A link that no longer answers gains nothing from a resubscribe
+    if (_linked[peer] && (probeFault || unboundFault))
+    {
+      LOGW("Peer %d stalled (%s)\n", peer, probeFault ? "link probes fail" : "unbound notifications");
+      start(domain, peer, probeFault ? RECOVER_RECONNECT : RECOVER_RESUBSCRIBE);
+    }
+    return;
+  }
+
+  if (domain.step == RECOVER_RECONNECT)
+  {
+    // Done once the link is down: NimBLE still works, reconnecting is routine
+    if (!_linked[peer])
+      recovered(domain);
+    else if (millis() - domain.stepMs >= stepTimeout(domain.step))
+      escalate(domain, peer);
+    return;
+  }
+
+  if (!_linked[peer])
+  {
+    // Went away by itself while recovering; nothing to credit
+    domain.faulted = false;
+    return;
+  }
+  if (!probeFault && !unboundFault)
+    recovered(domain);
+  else if (millis() - domain.stepMs >= stepTimeout(domain.step))
+    escalate(domain, peer);
+}
+
+void HealthMonitor::checkUsb()
+{
+  uint32_t now = millis();
+  bool hung = now - usbForwarder.heartbeatMs() > HEALTH_HEARTBEAT_STALL_MS;
+  bool failing = _usbMounted && usbForwarder.consecutiveFailures() >= HEALTH_USB_FAILURES &&
+                 now - usbForwarder.lastSuccessMs() > HEALTH_USB_STALL_MS;
+
+  if (!_usb.faulted)
+  {
+    if (hung || failing)
+    {
+      LOGW("USB stalled (%s)\n", hung ? "forwarding task hung" : "SendReport() keeps failing");
+      // A hung task cannot be restarted in place, and a re-init that only
+      // just cleared the last fault did not really help
+      bool refault = _usbRecoveredMs && now - _usbRecoveredMs < HEALTH_USB_REFAULT_MS;
+      start(_usb, HEALTH_USB, hung || refault ? RECOVER_REBOOT : RECOVER_USB_REINIT);
+    }
+    return;
+  }
+
+  // Recovered once the host enumerated again. The re-init cleared the
+  // failure count, and the mount is read from TinyUSB: the mount event may
+  // still be on its way.
+  if (!hung && tud_mounted() && usbForwarder.consecutiveFailures() == 0)
+  {
+    _usbRecoveredMs = now;
+    recovered(_usb);
+  }
+  else if (now - _usb.stepMs >= stepTimeout(_usb.step))
+    escalate(_usb, HEALTH_USB);
+}
+
+void HealthMonitor::start(Domain &domain, uint8_t target, uint8_t step)
+{
+  domain.faulted = true;
+  domain.faultMs = millis();
+  run(domain, target, step);
+}
+
+void HealthMonitor::escalate(Domain &domain, uint8_t target)
+{
+  // Reconnect and USB re-init have no in-place step left after them
+  uint8_t next = domain.step == RECOVER_RESUBSCRIBE ? RECOVER_RECONNECT : RECOVER_REBOOT;
+  LOGW("%s did not recover %s within %u ms\n", stepName(domain.step), target == HEALTH_USB ? "USB" : "the peer",
+       stepTimeout(domain.step));
+  run(domain, target, next);
+}
+
+void HealthMonitor::run(Domain &domain, uint8_t target, uint8_t step)
+{
+  domain.step = step;
+  domain.stepMs = millis();
+  _steps[step].attempts++;
+  LOGI("Recovery: %s\n", stepName(step));
+
+  if (step == RECOVER_REBOOT)
+  {
+    rtc.reboots++;
+    rtc.rebooting = true;
+  }
+
+  // A step that cannot start hands over to the next one right away
+  if ((!_action || !_action((RecoveryStep)step, target)) && step != RECOVER_REBOOT)
+    escalate(domain, target);
+}
+
+void HealthMonitor::recovered(Domain &domain)
+{
+  uint32_t ms = millis() - domain.faultMs;
+  StepStats &stats = _steps[domain.step];
+  stats.recovered++;
+  stats.lastMs = ms;
+  if (ms > stats.maxMs)
+    stats.maxMs = ms;
+  domain.faulted = false;
+  LOGI("Recovered by %s in %u ms\n", stepName(domain.step), ms);
+}
+
+void HealthMonitor::print(Print &out) const
+{
+  for (uint8_t i = 0; i < PROXY_MAX_PEERS; i++)
+  {
+    const Domain &domain = _peers[i];
+    if (domain.faulted)
+      out.printf("Peer %d: recovering (%s, %u ms)\n", i, stepName(domain.step), millis() - domain.faultMs);
+    else
+      out.printf("Peer %d: %s\n", i, _linked[i] ? "ok" : "not linked");
+  }
+  if (_usb.faulted)
+    out.printf("USB: recovering (%s, %u ms)\n", stepName(_usb.step), millis() - _usb.faultMs);
+  else
+    out.printf("USB: %s, forwarding task seen %u ms ago\n", _usbMounted ? "ok" : "not mounted",
+               millis() - usbForwarder.heartbeatMs());
+
+  for (uint8_t step = 0; step < RECOVER_STEP_COUNT; step++)
+  {
+    const StepStats &stats = _steps[step];
+    out.printf("  %-12s %4u tried %4u recovered  last %5u ms  max %5u ms\n", stepName(step), stats.attempts,
+               stats.recovered, stats.lastMs, stats.maxMs);
+  }
+  out.printf("  %u recovery reboots since power-on\n", rtc.reboots);
+}
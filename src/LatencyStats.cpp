@@ -0,0 +1,178 @@
+#include "LatencyStats.h"
+
+#if PROXY_LATENCY_STATS
+LatencyStats latencyStats;
+#endif
+
+static uint8_t bucketOf(uint32_t us)
+{
+  uint32_t units = us / LATENCY_BUCKET_US;
+  if (units < 8)
+    return units;
+
+  uint8_t octave = 31 - __builtin_clz(units);
+  uint32_t bucket = 8 + (octave - 3) * 4 + ((units >> (octave - 2)) & 3);
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Exclusive upper edge of a bucket in microseconds
+static uint32_t bucketLimitUs(uint8_t bucket)
+{
+  if (bucket < 8)
+    return (bucket + 1) * LATENCY_BUCKET_US;
+
+  uint8_t octave = 3 + (bucket - 8) / 4;
+  uint8_t sub = (bucket - 8) % 4;
+  return ((5u + sub) << (octave - 2)) * LATENCY_BUCKET_US;
+}
+
+LatencyStats::IdStats *LatencyStats::slot(uint8_t reportId)
+{
+  uint8_t index = _slotOf[reportId];
+  if (index)
+    return &_ids[index - 1];
+
+  // First report with this ID; both tasks may get here at once
+  IdStats *stats = nullptr;
+  portENTER_CRITICAL(&_lock);
+  index = _slotOf[reportId];
+  if (index)
+    stats = &_ids[index - 1];
+  else if (_used < LATENCY_MAX_IDS)
+  {
+    stats = &_ids[_used++];
+    stats->reportId = reportId;
+    _slotOf[reportId] = _used;
+  }
+  portEXIT_CRITICAL(&_lock);
+  return stats;
+}
+
+void LatencyStats::record(uint8_t reportId, uint32_t rxUs, uint32_t dequeueUs, uint32_t doneUs)
+{
+  IdStats *stats = slot(reportId);
+  if (!stats)
+    return;
+
+  uint32_t us[LATENCY_STAGES];
+  us[LATENCY_QUEUE] = dequeueUs - rxUs;
+  us[LATENCY_SEND] = doneUs - dequeueUs;
+  us[LATENCY_TOTAL] = doneUs - rxUs;
+
+  for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++)
+  {
+    stats->buckets[stage][bucketOf(us[stage])]++;
+    if (us[stage] > stats->maxUs[stage])
+      stats->maxUs[stage] = us[stage];
+  }
+  stats->count++;
+}
+
+void LatencyStats::fail(uint8_t reportId)
+{
+  IdStats *stats = slot(reportId);
+  if (stats)
+    stats->failed++;
+}
+
+void LatencyStats::drop(uint8_t reportId)
+{
+  IdStats *stats = slot(reportId);
+  if (stats)
+    stats->dropped++;
+}
+
+void LatencyStats::merge(uint8_t reportId)
+{
+  IdStats *stats = slot(reportId);
+  if (stats)
+    stats->merged++;
+}
+
+void LatencyStats::reset()
+{
+  // Keep the ID assignment, only the counters start over
+  for (uint8_t i = 0; i < _used; i++)
+  {
+    uint8_t reportId = _ids[i].reportId;
+    memset(&_ids[i], 0, sizeof(_ids[i]));
+    _ids[i].reportId = reportId;
+  }
+}
+
+// Upper edge of the bucket holding the given fraction of the samples
+static uint32_t percentileUs(const uint32_t *buckets, uint32_t count, uint8_t percent)
+{
+  uint32_t target = ((uint64_t)count * percent + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (seen >= target)
+      return bucketLimitUs(i);
+  }
+  return bucketLimitUs(LATENCY_BUCKETS - 1);
+}
+
+uint32_t LatencyStats::totalPercentileUs(uint8_t percent) const
+{
+  uint32_t buckets[LATENCY_BUCKETS] = {};
+  uint32_t count = 0;
+  for (uint8_t i = 0; i < _used; i++)
+  {
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+      buckets[b] += _ids[i].buckets[LATENCY_TOTAL][b];
+    count += _ids[i].count;
+  }
+  return count ? percentileUs(buckets, count, percent) : 0;
+}
+
+void LatencyStats::counters(size_t index, LatencyCounters &out) const
+{
+  const IdStats &stats = _ids[index];
+  out.reportId = stats.reportId;
+  out.sent = stats.count;
+  out.failed = stats.failed;
+  out.dropped = stats.dropped;
+  out.merged = stats.merged;
+  out.p99Us = stats.count ? percentileUs(stats.buckets[LATENCY_TOTAL], stats.count, 99) : 0;
+}
+
+void LatencyStats::print(Print &out, bool histogram)
+{
+  static const char *stageNames[LATENCY_STAGES] = {"queue", "send", "total"};
+
+  if (_used == 0)
+  {
+    out.println("No reports recorded");
+    return;
+  }
+
+  for (uint8_t i = 0; i < _used; i++)
+  {
+    const IdStats &stats = _ids[i];
+    out.printf("Report %3d: %u sent, %u merged, %u dropped, %u failed\n", stats.reportId,
+               stats.count, stats.merged, stats.dropped, stats.failed);
+    if (!stats.count)
+      continue;
+
+    for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++)
+    {
+      const uint32_t *buckets = stats.buckets[stage];
+      out.printf("  %-5s p50 <%6u us  p99 <%6u us  max %6u us\n", stageNames[stage],
+                 percentileUs(buckets, stats.count, 50),
+                 percentileUs(buckets, stats.count, 99), stats.maxUs[stage]);
+    }
+
+    if (!histogram)
+      continue;
+
+    out.print("  total histogram:");
+    for (uint8_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+      if (stats.buckets[LATENCY_TOTAL][b])
+        out.printf(" <%u:%u", bucketLimitUs(b), stats.buckets[LATENCY_TOTAL][b]);
+    }
+    out.println();
+  }
+}
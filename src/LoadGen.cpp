@@ -0,0 +1,273 @@
+#include "LoadGen.h"
+#include <NimBLEDevice.h>
+#include <NimBLEHIDDevice.h>
+#include <esp_timer.h>
+#include "Log.h"
+
+#if PROXY_LOADGEN
+LoadGenerator loadGen;
+#endif
+#if PROXY_SEQ_CHECK
+SeqCheck seqCheck;
+#endif
+
+#define LOADGEN_TASK_STACK 4096
+#define LOADGEN_TASK_PRIORITY 5
+#define LOADGEN_APPEARANCE 0x03C0 // generic HID
+
+static uint8_t reportLength(uint8_t index)
+{
+  return LOADGEN_HEADER_LENGTH + 4 * index;
+}
+
+#if PROXY_LOADGEN
+class LoadGenServerCallbacks : public NimBLEServerCallbacks
+{
+  void onConnect(NimBLEServer *server, NimBLEConnInfo &connInfo) override
+  {
+    LOGI("LoadGen: connected to %s\n", connInfo.getAddress().toString().c_str());
+    // Ask for the shortest interval; the central decides
+    server->updateConnParams(connInfo.getConnHandle(), 6, 6, 0, 100);
+  }
+
+  void onDisconnect(NimBLEServer *server, NimBLEConnInfo &connInfo, int reason) override
+  {
+    LOGI("LoadGen: disconnected (reason %d)\n", reason);
+    loadGen.onDisconnect();
+  }
+};
+
+class LoadGenReportCallbacks : public NimBLECharacteristicCallbacks
+{
+public:
+  explicit LoadGenReportCallbacks(uint8_t reportId) : _reportId(reportId) {}
+
+  void onSubscribe(NimBLECharacteristic *characteristic, NimBLEConnInfo &connInfo, uint16_t subValue) override
+  {
+    loadGen.onSubscribe(_reportId, subValue != 0);
+  }
+
+private:
+  uint8_t _reportId;
+};
+
+static LoadGenServerCallbacks serverCallbacks;
+
+void LoadGenerator::begin()
+{
+  static uint8_t reportMap[16 + LOADGEN_MAX_REPORT_IDS * 14];
+  static LoadGenReportCallbacks *reportCallbacks[LOADGEN_MAX_REPORT_IDS];
+
+  uint8_t count = PROXY_LOADGEN_REPORT_IDS;
+  if (count < 1 || count > LOADGEN_MAX_REPORT_IDS)
+    count = LOADGEN_MAX_REPORT_IDS;
+
+  // Vendor page collection with one fixed-size byte array report per ID
+  size_t n = 0;
+  const uint8_t header[] = {0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01};
+  memcpy(reportMap, header, sizeof(header));
+  n = sizeof(header);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    const uint8_t report[] = {0x85, (uint8_t)(i + 1), 0x09, 0x01, 0x15, 0x00, 0x26, 0xFF, 0x00,
+                              0x75, 0x08, 0x95, reportLength(i), 0x81, 0x02};
+    memcpy(reportMap + n, report, sizeof(report));
+    n += sizeof(report);
+  }
+  reportMap[n++] = 0xC0;
+
+  NimBLEDevice::init(LOADGEN_DEVICE_NAME);
+  NimBLEDevice::setSecurityAuth(true, false, true); // bonding, Just Works, SC
+  NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
+
+  NimBLEServer *server = NimBLEDevice::createServer();
+  server->setCallbacks(&serverCallbacks, false);
+  server->advertiseOnDisconnect(true);
+
+  NimBLEHIDDevice *hid = new NimBLEHIDDevice(server);
+  hid->setManufacturer("esp32-hid-proxy");
+  hid->setPnp(0x02, 0x303A, 0x4C47, 0x0100);
+  hid->setHidInfo(0x00, 0x01);
+  hid->setReportMap(reportMap, n);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    NimBLECharacteristic *report = hid->getInputReport(i + 1);
+    reportCallbacks[i] = new LoadGenReportCallbacks(i + 1);
+    report->setCallbacks(reportCallbacks[i]);
+    _reports[i] = report;
+  }
+  hid->setBatteryLevel(100);
+  hid->startServices();
+
+  NimBLEAdvertising *advertising = NimBLEDevice::getAdvertising();
+  advertising->setAppearance(LOADGEN_APPEARANCE);
+  advertising->addServiceUUID(hid->getHidService()->getUUID());
+  advertising->setName(LOADGEN_DEVICE_NAME);
+  advertising->start();
+
+  xTaskCreate(taskEntry, "loadgen", LOADGEN_TASK_STACK, this, LOADGEN_TASK_PRIORITY, &_task);
+
+  // The tick runs off esp_timer; FreeRTOS ticks are too coarse for 133 Hz
+  static esp_timer_handle_t timer;
+  esp_timer_create_args_t args = {};
+  args.callback = tick;
+  args.arg = this;
+  args.name = "loadgen";
+  esp_timer_create(&args, &timer);
+  esp_timer_start_periodic(timer, 1000000 / PROXY_LOADGEN_RATE_HZ);
+
+  LOGI("LoadGen: %d report IDs at %d Hz, pattern %d, advertising as %s\n", count,
+       PROXY_LOADGEN_RATE_HZ, PROXY_LOADGEN_PATTERN, LOADGEN_DEVICE_NAME);
+}
+
+void LoadGenerator::onSubscribe(uint8_t reportId, bool subscribed)
+{
+  uint8_t bit = 1 << (reportId - 1);
+  _subscribed = subscribed ? (_subscribed | bit) : (_subscribed & ~bit);
+}
+
+void LoadGenerator::onDisconnect()
+{
+  _subscribed = 0;
+}
+
+void LoadGenerator::tick(void *arg)
+{
+  xTaskNotifyGive(static_cast<LoadGenerator *>(arg)->_task);
+}
+
+void LoadGenerator::taskEntry(void *arg)
+{
+  static_cast<LoadGenerator *>(arg)->run();
+}
+
+void LoadGenerator::run()
+{
+  uint8_t next = 0;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!_subscribed)
+      continue;
+
+#if PROXY_LOADGEN_PATTERN == 1
+    for (uint8_t i = 0; i < LOADGEN_MAX_REPORT_IDS; i++)
+    {
+      if (_subscribed & (1 << i))
+        send(i);
+    }
+#else
+    // Next subscribed report in turn
+    for (uint8_t i = 0; i < LOADGEN_MAX_REPORT_IDS; i++)
+    {
+      uint8_t index = (next + i) % LOADGEN_MAX_REPORT_IDS;
+      if (_subscribed & (1 << index))
+      {
+        send(index);
+        next = index + 1;
+        break;
+      }
+    }
+#endif
+  }
+}
+
+bool LoadGenerator::send(uint8_t index)
+{
+  uint8_t data[LOADGEN_HEADER_LENGTH + 4 * (LOADGEN_MAX_REPORT_IDS - 1)];
+  uint8_t length = reportLength(index);
+
+  LoadGenHeader header = {LOADGEN_MAGIC, (uint8_t)(index + 1), _seq[index], (uint32_t)esp_timer_get_time()};
+  memcpy(data, &header, sizeof(header));
+  for (uint8_t i = sizeof(header); i < length; i++)
+    data[i] = header.seq + i;
+
+  // A refused notification keeps its sequence number: gaps mean real loss
+  auto *report = static_cast<NimBLECharacteristic *>(_reports[index]);
+  if (!report->notify(data, length))
+  {
+    _busy++;
+    return false;
+  }
+  _seq[index]++;
+  _sent++;
+  return true;
+}
+
+void LoadGenerator::poll()
+{
+  uint32_t now = millis();
+  if (now - _lastPrintMs < 1000)
+    return;
+
+  uint32_t sent = _sent;
+  if (_subscribed)
+    LOGI("LoadGen: %u reports/s, %u sent, %u refused\n", sent - _lastSent, sent, _busy);
+  _lastSent = sent;
+  _lastPrintMs = now;
+}
+#endif
+
+void SeqCheck::onReport(uint8_t peer, const uint8_t *data, size_t length, uint32_t rxUs)
+{
+  if (peer >= PROXY_MAX_PEERS || length < LOADGEN_HEADER_LENGTH || data[0] != LOADGEN_MAGIC)
+    return;
+
+  LoadGenHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.reportId < 1 || header.reportId > LOADGEN_MAX_REPORT_IDS)
+    return;
+
+  Stream &s = _streams[peer][header.reportId - 1];
+  int32_t delay = rxUs - header.sentUs;
+  if (!s.started)
+  {
+    s.started = true;
+    s.expected = header.seq;
+    s.minDelayUs = s.maxDelayUs = delay;
+  }
+
+  int16_t ahead = header.seq - s.expected;
+  if (ahead >= 0)
+  {
+    s.lost += ahead;
+    s.expected = header.seq + 1;
+  }
+  else if (ahead == -1)
+    s.duplicates++;
+  else
+    s.reordered++;
+  s.received++;
+
+  if (delay < s.minDelayUs)
+    s.minDelayUs = delay;
+  if (delay > s.maxDelayUs)
+    s.maxDelayUs = delay;
+}
+
+void SeqCheck::reset()
+{
+  memset(_streams, 0, sizeof(_streams));
+}
+
+void SeqCheck::print(Print &out) const
+{
+  bool any = false;
+  for (uint8_t peer = 0; peer < PROXY_MAX_PEERS; peer++)
+  {
+    for (uint8_t i = 0; i < LOADGEN_MAX_REPORT_IDS; i++)
+    {
+      const Stream &s = _streams[peer][i];
+      if (!s.started)
+        continue;
+
+      // Clocks are not synchronized: only the spread of rx - sent is meaningful
+      out.printf("peer %d id %d: %u received, %u lost, %u reordered, %u duplicate, delay spread %d us\n",
+                 peer + 1, i + 1, s.received, s.lost, s.reordered, s.duplicates,
+                 s.maxDelayUs - s.minDelayUs);
+      any = true;
+    }
+  }
+  if (!any)
+    out.println("No load generator reports received");
+}
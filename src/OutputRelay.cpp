@@ -0,0 +1,101 @@
+#include "OutputRelay.h"
+#include "ProxyEvents.h"
+
+OutputRelay outputRelay;
+
+void OutputRelay::submit(uint8_t usbReportId, uint8_t type, const uint8_t *data, size_t length)
+{
+  if (length == 0 || length > OUTPUT_REPORT_MAX_LENGTH)
+    return;
+
+  bool wake = false;
+  portENTER_CRITICAL(&_lock);
+  Entry *entry = nullptr;
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (_entries[i].reportId == usbReportId && _entries[i].type == type)
+      entry = &_entries[i];
+  }
+  if (!entry && _count < OUTPUT_RELAY_SLOTS)
+  {
+    entry = &_entries[_count++];
+    entry->reportId = usbReportId;
+    entry->type = type;
+    entry->length = 0;
+    entry->pending = false;
+  }
+
+  if (entry)
+  {
+    if (entry->length == length && memcmp(entry->data, data, length) == 0)
+      _deduped++;
+    else
+    {
+      if (entry->pending)
+        _deduped++;
+      memcpy(entry->data, data, length);
+      entry->length = length;
+      entry->pending = true;
+      wake = !_anyPending;
+      _anyPending = true;
+    }
+  }
+  portEXIT_CRITICAL(&_lock);
+
+  if (wake)
+    postEvent(EVENT_OUTPUT_REPORT);
+}
+
+bool OutputRelay::flush(OutputWriter write)
+{
+  if (!_anyPending)
+    return false;
+
+  uint32_t now = millis();
+  if (now - _lastFlushMs < OUTPUT_FLUSH_INTERVAL_MS)
+    return true;
+  _lastFlushMs = now;
+
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    // Copy out under the lock; the BLE write happens outside it
+    Entry entry;
+    portENTER_CRITICAL(&_lock);
+    entry = _entries[i];
+    _entries[i].pending = false;
+    portEXIT_CRITICAL(&_lock);
+
+    if (entry.pending)
+    {
+      write(entry.reportId, entry.type, entry.data, entry.length);
+      _written++;
+    }
+  }
+
+  portENTER_CRITICAL(&_lock);
+  _anyPending = false;
+  for (uint8_t i = 0; i < _count; i++)
+    _anyPending |= _entries[i].pending;
+  portEXIT_CRITICAL(&_lock);
+  return _anyPending;
+}
+
+uint32_t OutputRelay::flushDelayMs() const
+{
+  if (!_anyPending)
+    return UINT32_MAX;
+  uint32_t elapsed = millis() - _lastFlushMs;
+  return elapsed < OUTPUT_FLUSH_INTERVAL_MS ? OUTPUT_FLUSH_INTERVAL_MS - elapsed : 0;
+}
+
+void OutputRelay::resync()
+{
+  portENTER_CRITICAL(&_lock);
+  for (uint8_t i = 0; i < _count; i++)
+  {
+    if (_entries[i].length)
+      _entries[i].pending = true;
+  }
+  _anyPending = _count > 0;
+  portEXIT_CRITICAL(&_lock);
+}
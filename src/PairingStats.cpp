@@ -0,0 +1,92 @@
+#include "PairingStats.h"
+
+PairingStats pairingStats;
+
+void PairingStats::begin(uint8_t peer, SecurityPath path)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _peers[peer] = {millis(), path, true};
+  portEXIT_CRITICAL(&_lock);
+}
+
+void PairingStats::complete(uint8_t peer, bool encrypted)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  PeerTiming &timing = _peers[peer];
+  if (timing.pending)
+  {
+    PathStats &stats = _paths[timing.path];
+    if (encrypted)
+    {
+      uint32_t ms = millis() - timing.startMs;
+      stats.completed++;
+      stats.lastMs = ms;
+      stats.totalMs += ms;
+      if (ms > stats.maxMs)
+        stats.maxMs = ms;
+    }
+    else
+      stats.failed++;
+    timing.pending = false;
+  }
+  portEXIT_CRITICAL(&_lock);
+}
+
+void PairingStats::fallback(uint8_t peer)
+{
+  portENTER_CRITICAL(&_lock);
+  _fallbacks++;
+  portEXIT_CRITICAL(&_lock);
+  begin(peer, SECURITY_PAIRED);
+}
+
+void PairingStats::timeout(uint8_t peer)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  if (_peers[peer].pending)
+  {
+    _paths[_peers[peer].path].failed++;
+    _peers[peer].pending = false;
+  }
+  _timeouts++;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void PairingStats::print(Print &out) const
+{
+  static const char *names[SECURITY_PATH_COUNT] = {"stored key", "pairing"};
+
+  PathStats paths[SECURITY_PATH_COUNT];
+  portENTER_CRITICAL(&_lock);
+  memcpy(paths, _paths, sizeof(paths));
+  uint32_t fallbacks = _fallbacks;
+  uint32_t timeouts = _timeouts;
+  portEXIT_CRITICAL(&_lock);
+
+  for (uint8_t i = 0; i < SECURITY_PATH_COUNT; i++)
+  {
+    const PathStats &stats = paths[i];
+    out.printf("Security %-10s %5u ok %4u failed  last %5u ms  avg %5u ms  max %5u ms\n", names[i],
+               stats.completed, stats.failed, stats.lastMs,
+               stats.completed ? stats.totalMs / stats.completed : 0, stats.maxMs);
+  }
+  out.printf("Security: %u stored keys rejected (re-paired), %u timeouts\n", fallbacks, timeouts);
+}
+
+void PairingStats::reset()
+{
+  portENTER_CRITICAL(&_lock);
+  memset(_paths, 0, sizeof(_paths));
+  _fallbacks = 0;
+  _timeouts = 0;
+  portEXIT_CRITICAL(&_lock);
+}
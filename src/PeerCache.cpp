@@ -0,0 +1,85 @@
+#include "PeerCache.h"
+#include "Log.h"
+
+#include <Preferences.h>
+
+#define PEER_CACHE_NAMESPACE "peercache"
+
+// NVS keys are limited to 15 characters: 12 hex digits of address + suffix
+#define KEY_HANDLES 'h'
+#define KEY_REPORT_MAP 'm'
+
+PeerCache peerCache;
+
+void PeerCache::makeKey(char *key, const NimBLEAddress &address, char suffix)
+{
+  snprintf(key, 16, "%012llx%c", (unsigned long long)(uint64_t)address, suffix);
+}
+
+bool PeerCache::load(const NimBLEAddress &address, PeerCacheEntry &entry, uint8_t *reportMap, size_t capacity)
+{
+  char handlesKey[16];
+  char mapKey[16];
+  makeKey(handlesKey, address, KEY_HANDLES);
+  makeKey(mapKey, address, KEY_REPORT_MAP);
+
+  Preferences prefs;
+  if (!prefs.begin(PEER_CACHE_NAMESPACE, true))
+    return false;
+
+  bool hit = prefs.getBytes(handlesKey, &entry, sizeof(entry)) == sizeof(entry) &&
+             entry.version == PEER_CACHE_VERSION &&
+             entry.reportCount <= MAX_REPORT_BINDINGS &&
+             entry.reportMapSize > 0 && entry.reportMapSize <= capacity &&
+             prefs.getBytes(mapKey, reportMap, capacity) == entry.reportMapSize;
+
+  prefs.end();
+  return hit;
+}
+
+bool PeerCache::store(const NimBLEAddress &address, const PeerCacheEntry &entry, const uint8_t *reportMap)
+{
+  if (entry.reportMapSize == 0 || entry.reportMapSize > PEER_CACHE_MAX_REPORT_MAP)
+    return false;
+
+  char handlesKey[16];
+  char mapKey[16];
+  makeKey(handlesKey, address, KEY_HANDLES);
+  makeKey(mapKey, address, KEY_REPORT_MAP);
+
+  Preferences prefs;
+  if (!prefs.begin(PEER_CACHE_NAMESPACE, false))
+    return false;
+
+  // Write the map first so a torn update never pairs new handles with an old map
+  bool ok = prefs.putBytes(mapKey, reportMap, entry.reportMapSize) == entry.reportMapSize &&
+            prefs.putBytes(handlesKey, &entry, sizeof(entry)) == sizeof(entry);
+
+  prefs.end();
+  if (!ok)
+    LOGW("Failed to cache GATT handles for %s\n", address.toString().c_str());
+  return ok;
+}
+
+void PeerCache::remove(const NimBLEAddress &address)
+{
+  char key[16];
+  Preferences prefs;
+  if (!prefs.begin(PEER_CACHE_NAMESPACE, false))
+    return;
+
+  makeKey(key, address, KEY_HANDLES);
+  prefs.remove(key);
+  makeKey(key, address, KEY_REPORT_MAP);
+  prefs.remove(key);
+  prefs.end();
+}
+
+void PeerCache::clear()
+{
+  Preferences prefs;
+  if (!prefs.begin(PEER_CACHE_NAMESPACE, false))
+    return;
+  prefs.clear();
+  prefs.end();
+}
@@ -0,0 +1,143 @@
+#include "PowerManager.h"
+#include "Log.h"
+
+#if PROXY_POWER_MANAGEMENT && CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#define POWER_PM_LOCKS 1
+
+static esp_pm_lock_handle_t cpuLock;   // full clock while active
+static esp_pm_lock_handle_t sleepLock; // no light sleep while active
+static esp_pm_lock_handle_t usbLock;   // no light sleep while USB is mounted
+#else
+#define POWER_PM_LOCKS 0
+#endif
+
+PowerManager powerManager;
+
+void PowerManager::begin()
+{
+  _lastActivityMs = millis();
+
+#if POWER_PM_LOCKS
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "proxy_cpu", &cpuLock) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "proxy_sleep", &sleepLock) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "proxy_usb", &usbLock) != ESP_OK)
+  {
+    LOGE("Power management locks unavailable\n");
+    return;
+  }
+  acquire();
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t config = {};
+#else
+  esp_pm_config_esp32s3_t config = {};
+#endif
+  config.max_freq_mhz = getCpuFrequencyMhz();
+  config.min_freq_mhz = PROXY_IDLE_CPU_MHZ;
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  config.light_sleep_enable = true;
+#endif
+  esp_err_t err = esp_pm_configure(&config);
+  if (err != ESP_OK)
+    LOGW("Power management not configured (%d)\n", err);
+  else
+    LOGI("Power management: %d-%d MHz, light sleep %s\n", config.min_freq_mhz, config.max_freq_mhz,
+         config.light_sleep_enable ? "when idle" : "unavailable (no tickless idle)");
+#endif
+}
+
+void PowerManager::acquire()
+{
+#if POWER_PM_LOCKS
+  if (cpuLock)
+  {
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(sleepLock);
+  }
+#endif
+}
+
+void PowerManager::release()
+{
+#if POWER_PM_LOCKS
+  if (cpuLock)
+  {
+    esp_pm_lock_release(sleepLock);
+    esp_pm_lock_release(cpuLock);
+  }
+#endif
+}
+
+void PowerManager::onActivity()
+{
+  _lastActivityMs = millis();
+  if (_state == POWER_ACTIVE && !_displayDimmed)
+    return;
+
+  // Locks count, so a release racing in poll() still leaves them held
+  portENTER_CRITICAL(&_lock);
+  bool wake = _state != POWER_ACTIVE;
+  bool dimmed = _displayDimmed;
+  _state = POWER_ACTIVE;
+  _displayDimmed = false;
+  portEXIT_CRITICAL(&_lock);
+
+  if (wake)
+  {
+    acquire();
+    _wakes++;
+  }
+  if (dimmed)
+    statusDisplay.setBacklight(UI_BACKLIGHT_FULL);
+}
+
+void PowerManager::setUsbActive(bool active)
+{
+  if (active == _usbActive)
+    return;
+  _usbActive = active;
+
+#if POWER_PM_LOCKS
+  if (!usbLock)
+    return;
+  if (active)
+    esp_pm_lock_acquire(usbLock);
+  else
+    esp_pm_lock_release(usbLock);
+#endif
+}
+
+void PowerManager::poll()
+{
+  uint32_t idleMs = millis() - _lastActivityMs;
+
+  if (_state == POWER_ACTIVE && idleMs > PROXY_IDLE_SLEEP_S * 1000)
+  {
+    portENTER_CRITICAL(&_lock);
+    bool sleep = _state == POWER_ACTIVE && millis() - _lastActivityMs > PROXY_IDLE_SLEEP_S * 1000;
+    if (sleep)
+      _state = POWER_IDLE;
+    portEXIT_CRITICAL(&_lock);
+
+    if (sleep)
+    {
+      LOGD("Idle for %u s, allowing clock scaling and light sleep\n", idleMs / 1000);
+      release();
+    }
+  }
+
+  uint8_t level = UI_BACKLIGHT_FULL;
+  if (idleMs > PROXY_IDLE_OFF_S * 1000)
+    level = 0;
+  else if (idleMs > PROXY_IDLE_DIM_S * 1000)
+    level = PROXY_BACKLIGHT_DIM;
+
+  // Also catches up after onActivity() restored the backlight
+  if (level != _backlight)
+  {
+    _backlight = level;
+    _displayDimmed = level != UI_BACKLIGHT_FULL;
+    statusDisplay.setBacklight(level);
+  }
+}
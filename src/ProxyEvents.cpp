@@ -0,0 +1,25 @@
+#include "ProxyEvents.h"
+#include "Log.h"
+
+static QueueHandle_t eventQueue = nullptr;
+
+void proxyEventsBegin()
+{
+  if (!eventQueue)
+    eventQueue = xQueueCreate(PROXY_EVENT_QUEUE_LENGTH, sizeof(ProxyEvent));
+}
+
+bool postEvent(uint8_t type, uint8_t peer, int16_t status)
+{
+  ProxyEvent event = {type, peer, status};
+  if (eventQueue && xQueueSend(eventQueue, &event, 0) == pdTRUE)
+    return true;
+
+  LOGE("Event queue full, dropped event %d\n", type);
+  return false;
+}
+
+bool waitEvent(ProxyEvent &event, uint32_t timeoutMs)
+{
+  return eventQueue && xQueueReceive(eventQueue, &event, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+}
@@ -0,0 +1,129 @@
+#include "ProxyHIDDevice.h"
+#include "Log.h"
+#include "HIDReportMap.h"
+#include "OutputRelay.h"
+#include "tusb.h"
+
+#include <Preferences.h>
+
+#define USB_CACHE_NAMESPACE "usbdesc"
+#define KEY_DESCRIPTOR "desc"
+#define KEY_HASH "hash"
+
+// FNV-1a over the descriptor
+static uint32_t descriptorHash(const uint8_t *desc, uint16_t len)
+{
+  uint32_t hash = 2166136261u;
+  for (uint16_t i = 0; i < len; i++)
+    hash = (hash ^ desc[i]) * 16777619u;
+  return hash;
+}
+
+bool ProxyHIDDevice::begin()
+{
+  // The stack fixes the descriptor length now: register the real one, the
+  // cached descriptor is what the peers will most likely ask for again
+  if (_descriptorLength == 0 || !USBHID::addDevice(this, _descriptorLength))
+    return false;
+  _registeredLength = _descriptorLength;
+  return true;
+}
+
+bool ProxyHIDDevice::loadCached()
+{
+  Preferences prefs;
+  if (!prefs.begin(USB_CACHE_NAMESPACE, true))
+    return false;
+
+  size_t len = prefs.getBytes(KEY_DESCRIPTOR, _descriptor, USB_DESCRIPTOR_CAPACITY);
+  uint32_t hash = prefs.getUInt(KEY_HASH, 0);
+  prefs.end();
+
+  if (len == 0 || descriptorHash(_descriptor, len) != hash)
+    return false;
+
+  _descriptorLength = len;
+  _descriptorHash = hash;
+  return true;
+}
+
+void ProxyHIDDevice::storeCached()
+{
+  Preferences prefs;
+  if (!prefs.begin(USB_CACHE_NAMESPACE, false))
+    return;
+
+  // Hash last: a torn write fails the check in loadCached()
+  bool ok = prefs.putBytes(KEY_DESCRIPTOR, _descriptor, _descriptorLength) == _descriptorLength &&
+            prefs.putUInt(KEY_HASH, _descriptorHash) == sizeof(uint32_t);
+  prefs.end();
+  if (!ok)
+    LOGW("Failed to cache the USB report descriptor\n");
+}
+
+bool ProxyHIDDevice::setDescriptor(const uint8_t *desc, uint16_t len)
+{
+  if (len > USB_DESCRIPTOR_CAPACITY)
+  {
+    LOGE("Report descriptor too large: %d > %d bytes\n", len, USB_DESCRIPTOR_CAPACITY);
+    return false;
+  }
+
+  uint32_t hash = descriptorHash(desc, len);
+  if (_descriptorLength && len == _descriptorLength && hash == _descriptorHash)
+  {
+    LOGD("Report descriptor unchanged (%08x), USB stays attached\n", hash);
+    return true;
+  }
+
+  memcpy(_descriptor, desc, len);
+  _descriptorLength = len;
+  _descriptorHash = hash;
+  storeCached();
+
+  if (_registeredLength && len != _registeredLength)
+  {
+    // Stored for the next boot, which registers the new length
+    LOGI("Report descriptor changed to %d bytes (%08x), restart needed\n", len, hash);
+    _restartPending = true;
+  }
+  else if (_usbBuffer)
+  {
+    // USBHID only asks for the descriptor once and keeps its own copy;
+    // rewrite that copy and make the host enumerate again
+    LOGI("Report descriptor changed (%08x), re-attaching USB\n", hash);
+    reattach();
+  }
+  return true;
+}
+
+void ProxyHIDDevice::reattach()
+{
+  tud_disconnect();
+  if (_usbBuffer && _descriptorLength == _registeredLength)
+    memcpy(_usbBuffer, _descriptor, _descriptorLength);
+  vTaskDelay(pdMS_TO_TICKS(USB_REATTACH_DELAY_MS));
+  tud_connect();
+  _reattachCount++;
+}
+
+uint16_t ProxyHIDDevice::_onGetDescriptor(uint8_t *buffer)
+{
+  // USBHID hands out a slice of its configuration buffer sized by addDevice()
+  if (_descriptorLength == 0 || _descriptorLength != _registeredLength)
+    return 0;
+
+  memcpy(buffer, _descriptor, _descriptorLength);
+  _usbBuffer = buffer;
+  return _descriptorLength;
+}
+
+void ProxyHIDDevice::_onOutput(uint8_t report_id, const uint8_t *buffer, uint16_t len)
+{
+  outputRelay.submit(report_id, HID_REPORT_OUTPUT, buffer, len);
+}
+
+void ProxyHIDDevice::_onSetFeature(uint8_t report_id, const uint8_t *buffer, uint16_t len)
+{
+  outputRelay.submit(report_id, HID_REPORT_FEATURE, buffer, len);
+}
@@ -0,0 +1,208 @@
+#include "ReportCoalescer.h"
+#include <string.h>
+
+void ReportCoalescer::clear()
+{
+  _ruleCount = 0;
+  memset(_ruleOf, 0, sizeof(_ruleOf));
+  memset(_pendingOf, 0, sizeof(_pendingOf));
+  _pendingCount = 0;
+  _merged = 0;
+}
+
+void ReportCoalescer::configure(const HIDReportMap &map)
+{
+  _ruleCount = 0;
+  memset(_ruleOf, 0, sizeof(_ruleOf));
+
+  for (size_t i = 0; i < map.reportCount() && _ruleCount < COALESCE_MAX_PENDING; i++)
+  {
+    const HIDReportLayout &report = map.report(i);
+    if (report.type != HID_REPORT_INPUT)
+      continue;
+
+    // Mergeable reports consist of relative values and one-bit buttons only
+    Rule &rule = _rules[_ruleCount];
+    rule.mode = COALESCE_MERGE;
+    rule.fieldCount = 0;
+    bool relative = false;
+
+    const HIDField *fields = map.fields(report);
+    for (uint8_t f = 0; f < report.fieldCount && rule.mode == COALESCE_MERGE; f++)
+    {
+      const HIDField &field = fields[f];
+      if (field.flags & HID_FIELD_CONSTANT)
+        continue;
+
+      bool variable = field.flags & HID_FIELD_VARIABLE;
+      bool isRelative = variable && (field.flags & HID_FIELD_RELATIVE);
+      if ((!isRelative && !(variable && field.bitSize == 1)) || rule.fieldCount == COALESCE_MAX_FIELDS)
+      {
+        rule.mode = COALESCE_REPLACE;
+        break;
+      }
+
+      relative |= isRelative;
+      rule.fields[rule.fieldCount++] = field;
+    }
+
+    if (rule.mode == COALESCE_MERGE && relative)
+      _ruleOf[report.id] = ++_ruleCount;
+    else if (buildHoldRule(rule, map, report))
+      _ruleOf[report.id] = ++_ruleCount;
+  }
+}
+
+bool ReportCoalescer::buildHoldRule(Rule &rule, const HIDReportMap &map, const HIDReportLayout &report)
+{
+  if (report.kind != HID_KIND_KEYBOARD && report.kind != HID_KIND_CONSUMER)
+    return false;
+
+  // Key arrays and one-bit keys or modifiers carry the key state
+  rule.mode = COALESCE_HOLD;
+  rule.fieldCount = 0;
+  const HIDField *fields = map.fields(report);
+  for (uint8_t f = 0; f < report.fieldCount; f++)
+  {
+    const HIDField &field = fields[f];
+    bool variable = field.flags & HID_FIELD_VARIABLE;
+    if ((field.flags & HID_FIELD_CONSTANT) || (variable && field.bitSize != 1))
+      continue;
+
+    if (rule.fieldCount == COALESCE_MAX_FIELDS)
+    {
+      // Too many to check: never fold two different reports
+      rule.fieldCount = 0;
+      break;
+    }
+    rule.fields[rule.fieldCount++] = field;
+  }
+  return true;
+}
+
+bool ReportCoalescer::merge(const Rule &rule, ReportSlot &pending, const ReportSlot &report)
+{
+  if (pending.length != report.length)
+    return false;
+
+  // Build the result aside so a conflict leaves the pending report untouched
+  uint8_t merged[REPORT_SLOT_SIZE];
+  memcpy(merged, report.data, report.length);
+
+  for (uint8_t f = 0; f < rule.fieldCount; f++)
+  {
+    const HIDField &field = rule.fields[f];
+    if ((field.bitOffset + field.count * field.bitSize + 7) / 8 > report.length)
+      return false;
+
+    for (uint16_t e = 0; e < field.count; e++)
+    {
+      int32_t before = hidReadField(pending.data, field, e);
+      int32_t now = hidReadField(report.data, field, e);
+
+      if (field.flags & HID_FIELD_RELATIVE)
+      {
+        int64_t sum = (int64_t)before + now;
+        if (sum < field.logicalMin || sum > field.logicalMax)
+          return false;
+        hidWriteField(merged, field, e, (int32_t)sum);
+      }
+      else if (before != now)
+      {
+        // Every button edge must reach the host: folding a release into a
+        // re-press turns a double-click into one click
+        return false;
+      }
+    }
+  }
+
+  memcpy(pending.data, merged, report.length);
+  return true;
+}
+
+bool ReportCoalescer::changesKeys(const Rule &rule, const ReportSlot &pending, const ReportSlot &report)
+{
+  if (pending.length != report.length)
+    return true;
+  if (rule.fieldCount == 0)
+    return memcmp(pending.data, report.data, report.length) != 0;
+
+  for (uint8_t f = 0; f < rule.fieldCount; f++)
+  {
+    const HIDField &field = rule.fields[f];
+    if ((field.bitOffset + field.count * field.bitSize + 7) / 8 > report.length)
+      return true;
+
+    for (uint16_t e = 0; e < field.count; e++)
+    {
+      if (hidReadField(pending.data, field, e) != hidReadField(report.data, field, e))
+        return true;
+    }
+  }
+  return false;
+}
+
+CoalesceResult ReportCoalescer::add(const ReportSlot &report)
+{
+  uint8_t index = _pendingOf[report.reportId];
+  if (!index)
+  {
+    if (_pendingCount == COALESCE_MAX_PENDING)
+      return COALESCE_CONFLICT;
+
+    _pending[_pendingCount++] = report;
+    _pendingOf[report.reportId] = _pendingCount;
+    return COALESCE_QUEUED;
+  }
+
+  // The pending report keeps the timestamp of the oldest data it carries
+  ReportSlot &pending = _pending[index - 1];
+  uint8_t rule = _ruleOf[report.reportId];
+  if (rule && _rules[rule - 1].mode == COALESCE_MERGE)
+  {
+    if (!merge(_rules[rule - 1], pending, report))
+      return COALESCE_CONFLICT;
+  }
+  else if (rule && changesKeys(_rules[rule - 1], pending, report))
+  {
+    // The pending key state must reach the host before the next one, or a
+    // tap (press, release) or a double tap (release, press) is lost
+    return COALESCE_CONFLICT;
+  }
+  else
+  {
+    pending.length = report.length;
+    memcpy(pending.data, report.data, report.length);
+  }
+
+  _merged++;
+  return COALESCE_MERGED;
+}
+
+const ReportSlot *ReportCoalescer::findPending(uint8_t reportId) const
+{
+  uint8_t index = _pendingOf[reportId];
+  return index ? &_pending[index - 1] : nullptr;
+}
+
+void ReportCoalescer::removePending(uint8_t reportId)
+{
+  uint8_t index = _pendingOf[reportId];
+  if (!index)
+    return;
+
+  _pendingOf[reportId] = 0;
+  for (uint8_t i = index; i < _pendingCount; i++)
+  {
+    _pending[i - 1] = _pending[i];
+    _pendingOf[_pending[i - 1].reportId] = i;
+  }
+  _pendingCount--;
+}
+
+void ReportCoalescer::clearPending()
+{
+  for (uint8_t i = 0; i < _pendingCount; i++)
+    _pendingOf[_pending[i].reportId] = 0;
+  _pendingCount = 0;
+}
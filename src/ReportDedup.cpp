@@ -0,0 +1,68 @@
+#include "ReportDedup.h"
+#include <string.h>
+
+void ReportDedup::clear()
+{
+  memset(_entryOf, 0, sizeof(_entryOf));
+  _entryCount = 0;
+  _suppressed = 0;
+}
+
+void ReportDedup::configure(const HIDReportMap &map, uint8_t kinds)
+{
+  memset(_entryOf, 0, sizeof(_entryOf));
+  _entryCount = 0;
+
+  for (size_t i = 0; i < map.reportCount() && _entryCount < COALESCE_MAX_PENDING; i++)
+  {
+    const HIDReportLayout &report = map.report(i);
+    if (report.type != HID_REPORT_INPUT || !(kinds & (1 << report.kind)) || _entryOf[report.id])
+      continue;
+
+    bool relative = false;
+    const HIDField *fields = map.fields(report);
+    for (uint8_t f = 0; f < report.fieldCount; f++)
+      relative |= (fields[f].flags & HID_FIELD_RELATIVE) != 0;
+    if (relative)
+      continue;
+
+    Entry &entry = _entries[_entryCount];
+    entry.reportId = report.id;
+    entry.length = 0;
+    entry.suppressed = 0;
+    _entryOf[report.id] = ++_entryCount;
+  }
+}
+
+bool ReportDedup::isDuplicate(const ReportSlot &report)
+{
+  uint8_t index = _entryOf[report.reportId];
+  if (!index || report.length > REPORT_SLOT_SIZE)
+    return false;
+
+  // Straight from the slot: no copy unless the report is new
+  Entry &entry = _entries[index - 1];
+  if (entry.length == report.length && memcmp(entry.data, report.data, report.length) == 0)
+  {
+    entry.suppressed++;
+    _suppressed++;
+    return true;
+  }
+
+  memcpy(entry.data, report.data, report.length);
+  entry.length = report.length;
+  return false;
+}
+
+void ReportDedup::forget(uint8_t reportId)
+{
+  uint8_t index = _entryOf[reportId];
+  if (index)
+    _entries[index - 1].length = 0;
+}
+
+void ReportDedup::invalidate()
+{
+  for (uint8_t i = 0; i < _entryCount; i++)
+    _entries[i].length = 0;
+}
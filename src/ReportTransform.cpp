@@ -0,0 +1,223 @@
+#include "ReportTransform.h"
+#include <string.h>
+#include "TransformRules.h"
+
+TransformConfig transformConfig;
+
+// Usage pages and usages the transforms act on
+#define PAGE_GENERIC_DESKTOP 0x01
+#define PAGE_KEYBOARD 0x07
+#define USAGE_X 0x30
+#define USAGE_Y 0x31
+#define USAGE_WHEEL 0x38
+#define USAGE_LEFT_CONTROL 0xE0
+
+#define SCALE_ONE 256
+
+struct KeyRemapRule
+{
+  uint8_t from;
+  uint8_t to;
+};
+
+// Terminated by {0, 0}; the build-flag lists bring their own trailing commas
+static const KeyRemapRule keyRemapRules[] = {PROXY_KEY_REMAP{0, 0}};
+static const uint8_t dropReportIds[] = {PROXY_DROP_REPORT_IDS 0};
+
+static bool isModifier(uint8_t usage)
+{
+  return usage >= USAGE_LEFT_CONTROL && usage <= USAGE_LEFT_CONTROL + 7;
+}
+
+void TransformConfig::loadDefaults()
+{
+  for (int i = 0; i < 256; i++)
+    keyRemap[i] = i;
+  for (const KeyRemapRule *rule = keyRemapRules; rule->from; rule++)
+  {
+    // Bits of the modifier byte can only move within that byte
+    if (isModifier(rule->from) == isModifier(rule->to))
+      keyRemap[rule->from] = rule->to;
+  }
+
+  mouseScaleQ8 = PROXY_MOUSE_SCALE_Q8;
+  invertX = PROXY_INVERT_X;
+  invertY = PROXY_INVERT_Y;
+  invertWheel = PROXY_INVERT_WHEEL;
+  dropKinds = PROXY_DROP_KINDS;
+
+  memset(dropIds, 0, sizeof(dropIds));
+  for (uint8_t id : dropReportIds)
+  {
+    if (id)
+      dropIds[id / 8] |= 1 << (id % 8);
+  }
+}
+
+void ReportTransform::clear()
+{
+  memset(_drop, 0, sizeof(_drop));
+  memset(_rangeOf, 0, sizeof(_rangeOf));
+  _rangeCount = 0;
+  _opCount = 0;
+  for (int i = 0; i < 256; i++)
+    _keyMap[i] = _modifierMap[i] = i;
+}
+
+bool ReportTransform::addOp(const Op &op)
+{
+  if (_opCount == TRANSFORM_MAX_OPS)
+    return false;
+  _ops[_opCount++] = op;
+  return true;
+}
+
+void ReportTransform::compile(const HIDReportMap &map, const TransformConfig &config)
+{
+  clear();
+
+  bool remapKeys = false;
+  bool remapModifiers = false;
+  for (int usage = 0; usage < 256; usage++)
+  {
+    _keyMap[usage] = config.keyRemap[usage];
+    if (config.keyRemap[usage] != usage)
+      (isModifier(usage) ? remapModifiers : remapKeys) = true;
+  }
+
+  // Modifier byte -> modifier byte, so a remap is one lookup per report
+  if (remapModifiers)
+  {
+    for (int value = 0; value < 256; value++)
+    {
+      uint8_t out = 0;
+      for (uint8_t bit = 0; bit < 8; bit++)
+      {
+        if (value & (1 << bit))
+          out |= 1 << (config.keyRemap[USAGE_LEFT_CONTROL + bit] - USAGE_LEFT_CONTROL);
+      }
+      _modifierMap[value] = out;
+    }
+  }
+
+  for (size_t i = 0; i < map.reportCount(); i++)
+  {
+    const HIDReportLayout &report = map.report(i);
+    if (report.type != HID_REPORT_INPUT)
+      continue;
+
+    if ((config.dropKinds & (1u << report.kind)) || (config.dropIds[report.id / 8] & (1 << (report.id % 8))))
+    {
+      _drop[report.id / 8] |= 1 << (report.id % 8);
+      continue;
+    }
+
+    uint8_t first = _opCount;
+    const HIDField *fields = map.fields(report);
+    for (uint8_t f = 0; f < report.fieldCount; f++)
+    {
+      const HIDField &field = fields[f];
+      if (field.flags & HID_FIELD_CONSTANT)
+        continue;
+
+      bool variable = field.flags & HID_FIELD_VARIABLE;
+      bool byteAligned = field.bitOffset % 8 == 0;
+      Op op = {};
+
+      if (field.usagePage == PAGE_KEYBOARD && !variable && remapKeys && byteAligned && field.bitSize == 8)
+      {
+        op.type = OP_KEYS;
+        op.bitOffset = field.bitOffset;
+        op.count = field.count;
+        addOp(op);
+      }
+      else if (field.usagePage == PAGE_KEYBOARD && variable && remapModifiers && byteAligned &&
+               field.bitSize == 1 && field.count == 8 && field.usageMin == USAGE_LEFT_CONTROL)
+      {
+        op.type = OP_MODIFIERS;
+        op.bitOffset = field.bitOffset;
+        addOp(op);
+      }
+      else if (field.usagePage == PAGE_GENERIC_DESKTOP && variable && (field.flags & HID_FIELD_RELATIVE))
+      {
+        // One op per axis element that actually changes
+        for (uint16_t e = 0; e < field.count; e++)
+        {
+          uint16_t usage = field.usageMax > field.usageMin ? field.usageMin + e : field.usageMin;
+          int16_t scale = SCALE_ONE;
+          if (usage == USAGE_X)
+            scale = config.invertX ? -config.mouseScaleQ8 : config.mouseScaleQ8;
+          else if (usage == USAGE_Y)
+            scale = config.invertY ? -config.mouseScaleQ8 : config.mouseScaleQ8;
+          else if (usage == USAGE_WHEEL && config.invertWheel)
+            scale = -SCALE_ONE;
+
+          if (scale == SCALE_ONE)
+            continue;
+
+          op.type = OP_SCALE;
+          op.bitSize = field.bitSize;
+          op.bitOffset = field.bitOffset + e * field.bitSize;
+          op.scaleQ8 = scale;
+          op.logicalMin = field.logicalMin;
+          op.logicalMax = field.logicalMax;
+          addOp(op);
+        }
+      }
+    }
+
+    if (_opCount > first && _rangeCount < HID_MAX_REPORTS)
+    {
+      _ranges[_rangeCount] = {first, (uint8_t)(_opCount - first)};
+      _rangeOf[report.id] = ++_rangeCount;
+    }
+  }
+}
+
+void ReportTransform::apply(uint8_t reportId, uint8_t *data, size_t length)
+{
+  uint8_t range = _rangeOf[reportId];
+  if (!range)
+    return;
+
+  const Range &r = _ranges[range - 1];
+  for (uint8_t i = r.first; i < r.first + r.count; i++)
+  {
+    Op &op = _ops[i];
+    size_t byte = op.bitOffset / 8;
+
+    switch (op.type)
+    {
+    case OP_KEYS:
+      for (uint16_t k = 0; k < op.count && byte + k < length; k++)
+        data[byte + k] = _keyMap[data[byte + k]];
+      break;
+
+    case OP_MODIFIERS:
+      if (byte < length)
+        data[byte] = _modifierMap[data[byte]];
+      break;
+
+    case OP_SCALE:
+    {
+      if ((size_t)(op.bitOffset + op.bitSize + 7) / 8 > length)
+        break;
+
+      HIDField field = {};
+      field.bitOffset = op.bitOffset;
+      field.bitSize = op.bitSize;
+      field.logicalMin = op.logicalMin;
+      int32_t scaled = hidReadField(data, field, 0) * op.scaleQ8 + op.residual;
+      int32_t value = scaled >> 8;
+      op.residual = scaled - value * SCALE_ONE;
+
+      if (value < op.logicalMin)
+        value = op.logicalMin;
+      else if (value > op.logicalMax)
+        value = op.logicalMax;
+      hidWriteField(data, field, 0, value);
+      break;
+    }
+    }
+  }
+}
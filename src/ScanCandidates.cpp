@@ -0,0 +1,126 @@
+#include "ScanCandidates.h"
+#include "Log.h"
+#include <utility>
+
+void ScanCandidates::score(const NimBLEAdvertisedDevice &device, ScanCandidate &candidate)
+{
+  int16_t rssi = device.getRSSI();
+  bool bonded = NimBLEDevice::isBonded(device.getAddress());
+  uint16_t appearance = device.haveAppearance() ? device.getAppearance() : 0;
+  bool keyboardOrMouse = appearance == APPEARANCE_HID_KEYBOARD || appearance == APPEARANCE_HID_MOUSE;
+
+  // A bond outranks everything, then the device type, then signal strength
+  candidate.score = rssi + 100;
+  if (bonded)
+    candidate.score += 1000;
+  if (keyboardOrMouse)
+    candidate.score += 200;
+  else if ((appearance & 0xFFC0) == APPEARANCE_HID_GENERIC)
+    candidate.score += 100;
+  if (device.haveName())
+    candidate.score += 10;
+
+  candidate.confident = bonded || (keyboardOrMouse && rssi >= SCAN_STRONG_RSSI);
+}
+
+int ScanCandidates::find(const NimBLEAddress &address) const
+{
+  for (size_t i = 0; i < _count; i++)
+  {
+    if (_candidates[i].device.getAddress() == address)
+      return i;
+  }
+  return -1;
+}
+
+void ScanCandidates::remove(int index)
+{
+  // Swap rather than overwrite: every slot keeps its buffers for reuse
+  --_count;
+  if ((size_t)index != _count)
+    std::swap(_candidates[index], _candidates[_count]);
+}
+
+const ScanCandidate *ScanCandidates::add(const NimBLEAdvertisedDevice &device)
+{
+  if (device.getRSSI() < SCAN_MIN_RSSI)
+    return nullptr;
+
+  ScanCandidate candidate;
+  score(device, candidate);
+  candidate.seenMs = millis();
+
+  // Seen again (e.g. with its scan response): keep the newer, fuller data
+  int index = find(device.getAddress());
+  if (index >= 0)
+  {
+    _candidates[index].device = device;
+    _candidates[index].score = candidate.score;
+    _candidates[index].confident = candidate.confident;
+    _candidates[index].seenMs = candidate.seenMs;
+    return &_candidates[index];
+  }
+
+  if (_count == SCAN_MAX_CANDIDATES)
+  {
+    // Full: replace the weakest candidate if this one ranks higher
+    size_t weakest = 0;
+    for (size_t i = 1; i < _count; i++)
+    {
+      if (_candidates[i].score < _candidates[weakest].score)
+        weakest = i;
+    }
+    if (_candidates[weakest].score >= candidate.score)
+      return nullptr;
+
+    remove(weakest);
+  }
+
+  ScanCandidate &slot = _candidates[_count];
+  slot.device = device;
+  slot.score = candidate.score;
+  slot.confident = candidate.confident;
+  slot.seenMs = candidate.seenMs;
+  LOGD("  -> candidate, score %d%s\n", candidate.score, candidate.confident ? " (confident)" : "");
+  return &_candidates[_count++];
+}
+
+NimBLEAdvertisedDevice *ScanCandidates::takeBest()
+{
+  if (_count == 0)
+    return nullptr;
+
+  size_t best = 0;
+  for (size_t i = 1; i < _count; i++)
+  {
+    if (_candidates[i].score > _candidates[best].score)
+      best = i;
+  }
+
+  NimBLEAdvertisedDevice *device = new NimBLEAdvertisedDevice(_candidates[best].device);
+  remove(best);
+  return device;
+}
+
+NimBLEAdvertisedDevice *ScanCandidates::take(const NimBLEAddress &address)
+{
+  int index = find(address);
+  if (index < 0)
+    return nullptr;
+
+  NimBLEAdvertisedDevice *device = new NimBLEAdvertisedDevice(_candidates[index].device);
+  remove(index);
+  return device;
+}
+
+void ScanCandidates::expire(uint32_t maxAgeMs)
+{
+  uint32_t now = millis();
+  for (size_t i = 0; i < _count;)
+  {
+    if (now - _candidates[i].seenMs > maxAgeMs)
+      remove(i);
+    else
+      i++;
+  }
+}
@@ -0,0 +1,379 @@
+#include "StatusDisplay.h"
+#include <TFT_eSPI.h>
+#include "Peer.h"
+#include "Log.h"
+
+StatusDisplay statusDisplay;
+
+static TFT_eSPI tft = TFT_eSPI();
+
+// Two frame buffers: one is drawn while the other is still being sent
+static TFT_eSprite sprites[2] = {TFT_eSprite(&tft), TFT_eSprite(&tft)};
+static uint8_t nextSprite = 0;
+
+// Screen layout, landscape 240x135
+#define HEADER_HEIGHT 16
+#define PHASE_HEIGHT 24
+#define FOOTER_HEIGHT 16
+#define PEER_AREA_TOP (HEADER_HEIGHT + PHASE_HEIGHT)
+
+static const char *phaseName(uint8_t phase, uint16_t &color)
+{
+  switch (phase)
+  {
+  case UI_SCANNING:
+    color = TFT_MAGENTA;
+    return "SCANNING...";
+  case UI_RECONNECTING:
+    color = TFT_MAGENTA;
+    return "RECONNECTING...";
+  case UI_CONNECTING:
+    color = TFT_MAGENTA;
+    return "CONNECTING";
+  case UI_CONNECTED:
+    color = TFT_GREEN;
+    return "CONNECTED";
+  case UI_DISCONNECTED:
+    color = TFT_RED;
+    return "DISCONNECTED";
+  case UI_CONNECT_FAILED:
+    color = TFT_RED;
+    return "CONNECTION FAILED";
+  default:
+    color = TFT_WHITE;
+    return "BLE HID Proxy";
+  }
+}
+
+static const char *peerStateName(uint8_t state)
+{
+  switch (state)
+  {
+  case PEER_CONNECTING:
+    return "connecting";
+  case PEER_SECURING:
+    return "securing";
+  case PEER_DISCOVERING:
+    return "discovering";
+  case PEER_READY:
+    return "ready";
+  default:
+    return "away";
+  }
+}
+
+static uint16_t peerRowHeight()
+{
+  return (tft.height() - PEER_AREA_TOP - FOOTER_HEIGHT) / PROXY_MAX_PEERS;
+}
+
+void StatusDisplay::begin()
+{
+  if (_task)
+    return;
+
+  tft.begin();
+  tft.setRotation(1);
+  tft.fillScreen(TFT_BLACK);
+#ifdef TFT_BL
+  // TFT_eSPI switched the backlight on as a plain GPIO
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ledcAttach(TFT_BL, UI_BACKLIGHT_PWM_HZ, 8);
+#else
+  ledcSetup(UI_BACKLIGHT_PWM_CHANNEL, UI_BACKLIGHT_PWM_HZ, 8);
+  ledcAttachPin(TFT_BL, UI_BACKLIGHT_PWM_CHANNEL);
+#endif
+  applyBacklight(UI_BACKLIGHT_FULL);
+#endif
+#if PROXY_UI_DMA
+  // The display task is the only SPI user: keep the bus claimed for DMA.
+  // Sprite buffers are already in panel byte order.
+  tft.initDMA();
+  tft.setSwapBytes(false);
+  tft.startWrite();
+#endif
+
+  // Sized for the tallest region
+  uint16_t height = peerRowHeight() > PHASE_HEIGHT ? peerRowHeight() : PHASE_HEIGHT;
+  for (TFT_eSprite &sprite : sprites)
+  {
+    sprite.setColorDepth(16);
+    if (!sprite.createSprite(tft.width(), height))
+      LOGE("UI sprite allocation failed\n");
+  }
+
+  for (UiPeerStatus &peer : _status.peers)
+    peer.battery = UI_BATTERY_UNKNOWN;
+  _dirty = ~0u;
+
+  xTaskCreatePinnedToCore(taskEntry, "ui", UI_TASK_STACK, this, PROXY_UI_TASK_PRIORITY, &_task,
+                          PROXY_UI_TASK_CORE);
+}
+
+void StatusDisplay::markDirty(uint32_t regions)
+{
+  portENTER_CRITICAL(&_lock);
+  _dirty |= regions;
+  portEXIT_CRITICAL(&_lock);
+  if (_task)
+    xTaskNotifyGive(_task);
+}
+
+void StatusDisplay::setPhase(UiPhase phase)
+{
+  portENTER_CRITICAL(&_lock);
+  _status.phase = phase;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << REGION_PHASE);
+}
+
+void StatusDisplay::setUsbReady(bool ready)
+{
+  portENTER_CRITICAL(&_lock);
+  _status.usbReady = ready;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << REGION_HEADER);
+}
+
+void StatusDisplay::setPasskey(uint32_t passkey)
+{
+  portENTER_CRITICAL(&_lock);
+  _status.passkey = passkey;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << REGION_PHASE);
+}
+
+void StatusDisplay::setDevicesFound(uint8_t count)
+{
+  if (_status.devicesFound == count)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.devicesFound = count;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << REGION_FOOTER);
+}
+
+void StatusDisplay::setLatency(uint32_t p99Us)
+{
+  if (_status.latencyP99Us == p99Us)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.latencyP99Us = p99Us;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << REGION_FOOTER);
+}
+
+void StatusDisplay::setBacklight(uint8_t level)
+{
+  if (_backlight == level)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _backlight = level;
+  portEXIT_CRITICAL(&_lock);
+  if (_task)
+    xTaskNotifyGive(_task);
+}
+
+void StatusDisplay::applyBacklight(uint8_t level)
+{
+#ifdef TFT_BL
+  uint8_t duty = TFT_BACKLIGHT_ON ? level : UI_BACKLIGHT_FULL - level;
+#if ESP_ARDUINO_VERSION_MAJOR >= 3
+  ledcWrite(TFT_BL, duty);
+#else
+  ledcWrite(UI_BACKLIGHT_PWM_CHANNEL, duty);
+#endif
+#endif
+}
+
+void StatusDisplay::setPeerState(uint8_t peer, uint8_t state)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.peers[peer].state = state;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << (REGION_PEERS + peer));
+}
+
+void StatusDisplay::setPeerName(uint8_t peer, const char *name)
+{
+  if (peer >= PROXY_MAX_PEERS)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  strlcpy(_status.peers[peer].name, name, UI_NAME_LENGTH);
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << (REGION_PEERS + peer));
+}
+
+void StatusDisplay::setPeerRssi(uint8_t peer, int8_t rssi)
+{
+  if (peer >= PROXY_MAX_PEERS || _status.peers[peer].rssi == rssi)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.peers[peer].rssi = rssi;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << (REGION_PEERS + peer));
+}
+
+void StatusDisplay::setPeerBattery(uint8_t peer, uint8_t percent)
+{
+  if (peer >= PROXY_MAX_PEERS || _status.peers[peer].battery == percent)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.peers[peer].battery = percent;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << (REGION_PEERS + peer));
+}
+
+void StatusDisplay::setPeerRate(uint8_t peer, uint16_t reportRateHz)
+{
+  if (peer >= PROXY_MAX_PEERS || _status.peers[peer].reportRateHz == reportRateHz)
+    return;
+
+  portENTER_CRITICAL(&_lock);
+  _status.peers[peer].reportRateHz = reportRateHz;
+  portEXIT_CRITICAL(&_lock);
+  markDirty(1 << (REGION_PEERS + peer));
+}
+
+void StatusDisplay::snapshot(UiStatus &out)
+{
+  portENTER_CRITICAL(&_lock);
+  out = _status;
+  portEXIT_CRITICAL(&_lock);
+}
+
+void StatusDisplay::taskEntry(void *arg)
+{
+  static_cast<StatusDisplay *>(arg)->run();
+}
+
+void StatusDisplay::run()
+{
+  static UiStatus status;
+  uint8_t backlight = UI_BACKLIGHT_FULL;
+
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    // Work on a snapshot so setters never wait for SPI
+    portENTER_CRITICAL(&_lock);
+    status = _status;
+    uint32_t dirty = _dirty;
+    uint8_t level = _backlight;
+    // While dark, changes pile up and are drawn once the panel is lit again
+    if (level)
+      _dirty = 0;
+    portEXIT_CRITICAL(&_lock);
+
+    if (level != backlight)
+    {
+      applyBacklight(level);
+      backlight = level;
+    }
+    if (!level)
+      continue;
+
+    for (uint8_t region = 0; region < REGION_PEERS + PROXY_MAX_PEERS; region++)
+    {
+      if (dirty & (1 << region))
+        render(region, status);
+    }
+
+    // Changes made meanwhile are picked up by the next frame
+    vTaskDelay(pdMS_TO_TICKS(UI_FRAME_INTERVAL_MS));
+  }
+}
+
+void StatusDisplay::render(uint8_t region, const UiStatus &status)
+{
+  // pushImageDMA() waits for the previous transfer before starting, so the
+  // buffer pushed two regions ago is free while the last one is still sending
+  TFT_eSprite &sprite = sprites[nextSprite];
+  nextSprite ^= 1;
+
+  uint16_t top;
+  uint16_t height;
+  sprite.fillSprite(TFT_BLACK);
+  sprite.setTextDatum(TL_DATUM);
+
+  if (region == REGION_HEADER)
+  {
+    top = 0;
+    height = HEADER_HEIGHT;
+    sprite.setTextColor(TFT_WHITE);
+    sprite.drawString("BLE HID Proxy", 2, 0, 2);
+    sprite.setTextColor(status.usbReady ? TFT_GREEN : TFT_DARKGREY);
+    sprite.setTextDatum(TR_DATUM);
+    sprite.drawString(status.usbReady ? "USB READY" : "USB --", tft.width() - 2, 0, 2);
+  }
+  else if (region == REGION_PHASE)
+  {
+    top = HEADER_HEIGHT;
+    height = PHASE_HEIGHT;
+    sprite.setTextDatum(MC_DATUM);
+    if (status.passkey)
+    {
+      char text[24];
+      snprintf(text, sizeof(text), "PASSKEY %06u", status.passkey);
+      sprite.setTextColor(TFT_MAGENTA);
+      sprite.drawString(text, tft.width() / 2, height / 2, 2);
+    }
+    else
+    {
+      uint16_t color;
+      const char *text = phaseName(status.phase, color);
+      sprite.setTextColor(color);
+      sprite.drawString(text, tft.width() / 2, height / 2, 2);
+    }
+  }
+  else if (region == REGION_FOOTER)
+  {
+    top = tft.height() - FOOTER_HEIGHT;
+    height = FOOTER_HEIGHT;
+    char text[48];
+    if (status.latencyP99Us)
+      snprintf(text, sizeof(text), "HID devices: %d   p99 %u us", status.devicesFound, status.latencyP99Us);
+    else
+      snprintf(text, sizeof(text), "HID devices: %d", status.devicesFound);
+    sprite.setTextColor(TFT_LIGHTGREY);
+    sprite.drawString(text, 2, 4, 1);
+  }
+  else
+  {
+    uint8_t index = region - REGION_PEERS;
+    const UiPeerStatus &peer = status.peers[index];
+    height = peerRowHeight();
+    top = PEER_AREA_TOP + index * height;
+
+    char text[48];
+    snprintf(text, sizeof(text), "%d %s", index + 1, peer.name[0] ? peer.name : "-");
+    sprite.setTextColor(peer.state == PEER_READY ? TFT_GREEN : TFT_WHITE);
+    sprite.drawString(text, 2, 2, 2);
+    sprite.setTextDatum(TR_DATUM);
+    sprite.drawString(peerStateName(peer.state), tft.width() - 2, 2, 2);
+
+    char battery[8] = "--";
+    if (peer.battery != UI_BATTERY_UNKNOWN)
+      snprintf(battery, sizeof(battery), "%d%%", peer.battery);
+    snprintf(text, sizeof(text), "RSSI %d  BATT %s  %u Hz", peer.rssi, battery, peer.reportRateHz);
+    sprite.setTextDatum(TL_DATUM);
+    sprite.setTextColor(TFT_LIGHTGREY);
+    sprite.drawString(text, 2, 22, 1);
+  }
+
+#if PROXY_UI_DMA
+  tft.pushImageDMA(0, top, tft.width(), height, (uint16_t *)sprite.getPointer());
+#else
+  sprite.pushSprite(0, top, 0, 0, tft.width(), height);
+#endif
+}
@@ -0,0 +1,205 @@
+#include "Telemetry.h"
+#include "LatencyStats.h"
+#include "OutputRelay.h"
+#include "StatusDisplay.h"
+#include "UsbForwarder.h"
+
+Telemetry telemetry;
+
+#define TELEMETRY_TASKS 4
+
+// Largest payload (a telemetry frame) and the bytes a frame adds around it
+#define TELEMETRY_MAX_PAYLOAD                                                         \
+  (sizeof(TelemetryHeader) + PROXY_MAX_PEERS * sizeof(TelemetryPeer) +                \
+   TELEMETRY_TASKS * sizeof(TelemetryTask) + LATENCY_MAX_IDS * sizeof(TelemetryReport))
+#define TELEMETRY_FRAME_OVERHEAD 7
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+bool Telemetry::feed(uint8_t byte)
+{
+  switch (_state)
+  {
+  case PARSE_SYNC1:
+    if (byte != TELEMETRY_SYNC1)
+      return false;
+    _state = PARSE_SYNC2;
+    return true;
+
+  case PARSE_SYNC2:
+    _state = byte == TELEMETRY_SYNC2 ? PARSE_TYPE : PARSE_SYNC1;
+    return true;
+
+  case PARSE_TYPE:
+    _type = byte;
+    _crc = crc16(0xFFFF, &byte, 1);
+    _state = PARSE_LENGTH_LOW;
+    return true;
+
+  case PARSE_LENGTH_LOW:
+    _length = byte;
+    _crc = crc16(_crc, &byte, 1);
+    _state = PARSE_LENGTH_HIGH;
+    return true;
+
+  case PARSE_LENGTH_HIGH:
+    _length |= byte << 8;
+    _crc = crc16(_crc, &byte, 1);
+    _received = 0;
+    if (_length > TELEMETRY_MAX_COMMAND)
+      _state = PARSE_SYNC1; // not a command we know, resynchronize
+    else
+      _state = _length ? PARSE_PAYLOAD : PARSE_CRC_LOW;
+    return true;
+
+  case PARSE_PAYLOAD:
+    _payload[_received++] = byte;
+    _crc = crc16(_crc, &byte, 1);
+    if (_received == _length)
+      _state = PARSE_CRC_LOW;
+    return true;
+
+  case PARSE_CRC_LOW:
+    _crc ^= byte;
+    _state = PARSE_CRC_HIGH;
+    return true;
+
+  case PARSE_CRC_HIGH:
+    _crc ^= byte << 8;
+    _state = PARSE_SYNC1;
+    if (_crc == 0)
+      dispatch();
+    return true;
+  }
+  return false;
+}
+
+void Telemetry::dispatch()
+{
+  uint8_t status = TELEMETRY_OK;
+  switch (_type)
+  {
+  case FRAME_GET_TELEMETRY:
+    sendTelemetry();
+    return;
+
+  case FRAME_STREAM:
+    if (_length != 2)
+      status = TELEMETRY_BAD_LENGTH;
+    else
+      _streamIntervalMs = _payload[0] | (_payload[1] << 8);
+    break;
+
+  default:
+    status = _handler ? _handler(_type, _payload, _length) : TELEMETRY_UNKNOWN_COMMAND;
+    break;
+  }
+
+  uint8_t ack[2] = {_type, status};
+  sendFrame(FRAME_ACK, ack, sizeof(ack));
+}
+
+void Telemetry::poll()
+{
+  if (!_streamIntervalMs || millis() - _lastStreamMs < _streamIntervalMs)
+    return;
+  _lastStreamMs = millis();
+  sendTelemetry();
+}
+
+void Telemetry::countEvent(uint8_t type)
+{
+  if (type < EVENT_TYPE_COUNT)
+    _events[type]++;
+}
+
+void Telemetry::sendTelemetry()
+{
+  static uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+  size_t n = sizeof(TelemetryHeader);
+
+  TelemetryHeader header = {};
+  header.version = TELEMETRY_VERSION;
+  header.uptimeMs = millis();
+  header.heapFree = ESP.getFreeHeap();
+  header.heapMinFree = ESP.getMinFreeHeap();
+  header.forwarderDropped = usbForwarder.droppedCount();
+  header.forwarderFailed = usbForwarder.failedCount();
+  header.forwarderMerged = usbForwarder.mergedCount();
+  header.outputWritten = outputRelay.writtenCount();
+  header.outputDeduped = outputRelay.dedupedCount();
+  memcpy(header.events, _events, sizeof(_events));
+
+  static UiStatus status;
+  statusDisplay.snapshot(status);
+  for (uint8_t i = 0; i < PROXY_MAX_PEERS; i++)
+  {
+    const UiPeerStatus &peer = status.peers[i];
+    TelemetryPeer record = {peer.state, peer.rssi, peer.battery, 0, peer.reportRateHz};
+    memcpy(payload + n, &record, sizeof(record));
+    n += sizeof(record);
+  }
+  header.peerCount = PROXY_MAX_PEERS;
+
+  // Stack low-water marks; ESP-IDF reports them in bytes
+  const TaskHandle_t tasks[TELEMETRY_TASKS] = {xTaskGetCurrentTaskHandle(), usbForwarder.task(),
+                                               statusDisplay.task(), xTaskGetHandle("nimble_host")};
+  for (TaskHandle_t task : tasks)
+  {
+    if (!task)
+      continue;
+    TelemetryTask record = {};
+    strlcpy(record.name, pcTaskGetName(task), sizeof(record.name));
+    record.stackFreeMin = uxTaskGetStackHighWaterMark(task);
+    memcpy(payload + n, &record, sizeof(record));
+    n += sizeof(record);
+    header.taskCount++;
+  }
+
+#if PROXY_LATENCY_STATS
+  header.latencyP50Us = latencyStats.totalPercentileUs(50);
+  header.latencyP99Us = latencyStats.totalPercentileUs(99);
+  for (size_t i = 0; i < latencyStats.idCount(); i++)
+  {
+    LatencyCounters counters;
+    latencyStats.counters(i, counters);
+    TelemetryReport record = {counters.reportId, {}, counters.sent, counters.failed,
+                              counters.dropped, counters.merged, counters.p99Us};
+    memcpy(payload + n, &record, sizeof(record));
+    n += sizeof(record);
+    header.idCount++;
+  }
+#endif
+
+  memcpy(payload, &header, sizeof(header));
+  sendFrame(FRAME_TELEMETRY, payload, n);
+}
+
+void Telemetry::sendFrame(uint8_t type, const uint8_t *payload, size_t length)
+{
+  // One write per frame: log lines from other tasks cannot land inside it
+  static uint8_t frame[TELEMETRY_FRAME_OVERHEAD + TELEMETRY_MAX_PAYLOAD];
+  if (length > TELEMETRY_MAX_PAYLOAD)
+    return;
+
+  frame[0] = TELEMETRY_SYNC1;
+  frame[1] = TELEMETRY_SYNC2;
+  frame[2] = type;
+  frame[3] = length;
+  frame[4] = length >> 8;
+  memcpy(frame + 5, payload, length);
+  uint16_t crc = crc16(0xFFFF, frame + 2, 3 + length);
+  frame[5 + length] = crc;
+  frame[6 + length] = crc >> 8;
+
+  Serial.write(frame, TELEMETRY_FRAME_OVERHEAD + length);
+}
@@ -0,0 +1,56 @@
+#include "Trace.h"
+
+#if PROXY_TRACE
+TraceBuffer bleTrace("BLE");
+TraceBuffer usbTrace("USB");
+#endif
+
+static const char *traceEventName(uint8_t event)
+{
+  switch (event)
+  {
+  case TRACE_REPORT_RX:
+    return "RX";
+  case TRACE_REPORT_DROP:
+    return "DROP";
+  case TRACE_SEND_FAIL:
+    return "SEND FAILED";
+  case TRACE_REPORT_UNKNOWN:
+    return "UNKNOWN";
+  case TRACE_REPORT_FILTERED:
+    return "FILTERED";
+  case TRACE_REPORT_UNMAPPED:
+    return "UNMAPPED";
+  default:
+    return "?";
+  }
+}
+
+void TraceBuffer::flush(Print &out)
+{
+  TraceRecord *rec;
+  while ((rec = _ring.front()) != nullptr)
+  {
+    out.printf("[%10u] %s %s id=%d len=%d:", rec->timestampUs, _name,
+               traceEventName(rec->event), rec->reportId, rec->length);
+    size_t n = rec->length < TRACE_DATA_BYTES ? rec->length : TRACE_DATA_BYTES;
+    for (size_t i = 0; i < n; i++)
+      out.printf(" %02X", rec->data[i]);
+    if (rec->length > TRACE_DATA_BYTES)
+      out.print(" ...");
+    out.println();
+    _ring.pop();
+  }
+
+  uint32_t lost = _overflow.exchange(0, std::memory_order_relaxed);
+  if (lost)
+    out.printf("[trace] %s: %u records lost\n", _name, lost);
+}
+
+void traceFlush()
+{
+#if PROXY_TRACE
+  bleTrace.flush(Serial);
+  usbTrace.flush(Serial);
+#endif
+}
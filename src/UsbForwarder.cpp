@@ -0,0 +1,126 @@
+#include "UsbForwarder.h"
+#include "Log.h"
+#include "Trace.h"
+#include "LatencyStats.h"
+#include "esp_task_wdt.h"
+
+UsbForwarder usbForwarder;
+
+void UsbForwarder::begin(USBHID *hid)
+{
+  if (_task)
+    return;
+
+  _hid = hid;
+  _rulesLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(taskEntry, "usb_fwd", USB_FORWARD_TASK_STACK, this,
+                          PROXY_USB_TASK_PRIORITY, &_task, PROXY_USB_TASK_CORE);
+}
+
+ReportSlot *UsbForwarder::beginReport(uint8_t peer, uint8_t reportId)
+{
+  ReportSlot *slot = nullptr;
+  if (_task && peer < PROXY_MAX_PEERS)
+    slot = _pipeline.beginReport(peer);
+
+  if (!slot)
+  {
+    _dropped++;
+    LATENCY_DROP(reportId);
+  }
+  return slot;
+}
+
+void UsbForwarder::commitReport(uint8_t peer)
+{
+  _pipeline.commitReport(peer);
+  xTaskNotifyGive(_task);
+}
+
+void UsbForwarder::setReportMap(const uint8_t *descriptor, size_t length)
+{
+  // Parsed outside the lock; only loop() calls this
+  static HIDReportMap map;
+  map.parse(descriptor, length);
+
+  if (!_rulesLock)
+  {
+    _pipeline.configure(map);
+    return;
+  }
+
+  xSemaphoreTake(_rulesLock, portMAX_DELAY);
+  _pipeline.configure(map);
+  xSemaphoreGive(_rulesLock);
+}
+
+void UsbForwarder::resetHostState()
+{
+  if (!_rulesLock)
+    return;
+
+  xSemaphoreTake(_rulesLock, portMAX_DELAY);
+  _pipeline.forgetSent();
+  _consecutiveFailures = 0;
+  xSemaphoreGive(_rulesLock);
+}
+
+void UsbForwarder::taskEntry(void *arg)
+{
+  static_cast<UsbForwarder *>(arg)->run();
+}
+
+void UsbForwarder::run()
+{
+  // A SendReport() that never returns trips the task watchdog
+  if (esp_task_wdt_add(nullptr) != ESP_OK)
+    LOGW("USB forwarding task not watched\n");
+
+  for (;;)
+  {
+    _heartbeatMs = millis();
+    esp_task_wdt_reset();
+    if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(USB_FORWARD_HEARTBEAT_MS)))
+      continue;
+
+    // Reports that arrived while the previous transfer was in flight are
+    // merged into one per report ID, so each IN transfer carries the latest state
+    while (collect())
+      sendPending();
+  }
+}
+
+bool UsbForwarder::collect()
+{
+  xSemaphoreTake(_rulesLock, portMAX_DELAY);
+  bool collected = _pipeline.collect([this](const ReportSlot &report) { send(report); },
+                                     [](uint8_t reportId) { LATENCY_MERGE(reportId); });
+  xSemaphoreGive(_rulesLock);
+  return collected;
+}
+
+void UsbForwarder::sendPending()
+{
+  _pipeline.sendPending([this](const ReportSlot &report) { send(report); });
+}
+
+void UsbForwarder::send(const ReportSlot &report)
+{
+  // SendReport() returns once the IN transfer completes (or times out)
+  uint32_t sendUs = LATENCY_STAMP();
+  bool success = _hid->SendReport(report.reportId, report.data, report.length);
+  if (success)
+  {
+    _consecutiveFailures = 0;
+    _lastSuccessMs = millis();
+    LATENCY_RECORD(report.reportId, report.rxUs, sendUs, LATENCY_STAMP());
+    return;
+  }
+
+  _failed++;
+  _consecutiveFailures++;
+  _pipeline.forgetSent(report.reportId);
+  LATENCY_FAIL(report.reportId);
+  TRACE_USB(TRACE_SEND_FAIL, report.reportId, report.data, report.length);
+  LOGV("SendReport(id=%d, len=%d) -> FAILED\n", report.reportId, report.length);
+}
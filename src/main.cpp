@@ -1,160 +1,417 @@
 #include <Arduino.h>
 #include <NimBLEDevice.h>
-#include <TFT_eSPI.h>
 #include "USB.h"
 #include "USBHID.h"
+#include "UsbForwarder.h"
+#include "ProxyHIDDevice.h"
+#include "CompositeDescriptor.h"
+#include "Peer.h"
+#include "PeerCache.h"
+#include "ProxyEvents.h"
+#include "ConnTuner.h"
+#include "LatencyStats.h"
+#include "Console.h"
+#include "StatusDisplay.h"
+#include "ScanCandidates.h"
+#include "LoadGen.h"
+#include "OutputRelay.h"
+#include "DeviceInfo.h"
+#include "Telemetry.h"
+#include "PairingStats.h"
+#include "PowerManager.h"
+#include "HealthMonitor.h"
+#include "Log.h"
+#include "Trace.h"
+
+#if !CONFIG_FREERTOS_UNICORE && PROXY_USB_TASK_CORE == CONFIG_BT_NIMBLE_PINNED_TO_CORE
+#warning "USB forwarding task shares a core with the NimBLE host"
+#endif
 
 // HID Service and Characteristic UUIDs
 static NimBLEUUID HID_SERVICE_UUID((uint16_t)0x1812);
 static NimBLEUUID HID_REPORT_MAP_UUID((uint16_t)0x2A4B);
 static NimBLEUUID HID_REPORT_UUID((uint16_t)0x2A4D);
-static NimBLEUUID HID_INFO_UUID((uint16_t)0x2A4A);
+static NimBLEUUID HID_REPORT_REFERENCE_UUID((uint16_t)0x2908);
+static NimBLEUUID CCCD_UUID((uint16_t)0x2902);
 static NimBLEUUID BATTERY_SERVICE_UUID((uint16_t)0x180F);
 static NimBLEUUID BATTERY_LEVEL_UUID((uint16_t)0x2A19);
-static NimBLEUUID DEVICE_INFO_UUID((uint16_t)0x180A);
-static NimBLEUUID GAP_SERVICE_UUID((uint16_t)0x1800);
-static NimBLEUUID DEVICE_NAME_UUID((uint16_t)0x2A00);
-static NimBLEUUID PNP_ID_UUID((uint16_t)0x2A50);
-static NimBLEUUID MANUFACTURER_NAME_UUID((uint16_t)0x2A29);
 
-// Scan duration in milliseconds
+// Full (active) scan: duration in milliseconds, interval and window in
+// 0.625 ms units. Build environments override these.
+#ifndef SCAN_DURATION
 #define SCAN_DURATION 2000
+#endif
+#ifndef SCAN_INTERVAL
+#define SCAN_INTERVAL 80
+#endif
+#ifndef SCAN_WINDOW
+#define SCAN_WINDOW 48
+#endif
+
+// Whitelist-only scan for bonded peers, tried before the full scan
+#define RECONNECT_SCAN_DURATION 10000
+#define RECONNECT_SCAN_INTERVAL 48 // 30 ms, continuous when window == interval
+#define RECONNECT_SCAN_WINDOW_LINKED 12
+// While other peers are linked, a bond that stays away gets this many rounds
+// back to back, then one round per backoff period with background scans in
+// between, so the links are not taxed indefinitely
+#define RECONNECT_ROUNDS_LINKED 3
+#define RECONNECT_BACKOFF_MS 60000
+
+// Passive background scan while nothing else needs the radio: one short
+// window per interval. Nothing aligns it with the links' connection events;
+// the controller arbitrates and a connection event wins over the window. An
+// odd interval in 0.625 ms units is no multiple of the 1.25 ms connection
+// interval unit, so a window that lost to a connection event drifts off it.
+#define BACKGROUND_SCAN_INTERVAL 1601 // ~1 s
+#define BACKGROUND_SCAN_WINDOW 4      // 2.5 ms
+#define BACKGROUND_SCAN_DURATION 30000
+
+// Standby devices older than this are not connected to without a scan
+#define STANDBY_MAX_AGE 60000
+
+// Connection attempt timeout in milliseconds
+#define CONNECT_TIMEOUT 5000
+
+// Time to wait for encryption before continuing without it
+#define SECURE_TIMEOUT 5000
+
+// Housekeeping period of loop() while no events arrive
+#define EVENT_POLL_INTERVAL 100
+
+// How often link quality, report rate and latency are sampled for the display
+#define STATUS_UPDATE_INTERVAL 1000
 
 // Device name to advertise
 #define DEVICE_NAME "ESP_HID_Proxy"
 
-// Connected device handle
-static NimBLEClient *pClient = nullptr;
-static bool deviceConnected = false;
-static bool doConnect = false;
-static NimBLEAdvertisedDevice *advDevice = nullptr;
+// BLE HID peripherals being proxied
+static Peer peers[PROXY_MAX_PEERS];
+static bool reconnectScan = false; // current scan only reports whitelisted peers
+static bool backgroundScan = false; // current scan only fills the standby list
+static bool fullScanDue = false;   // last reconnect scan found nothing
+static uint8_t reconnectRounds = 0; // reconnect scans run while linked
+static uint32_t lastReconnectMs = 0;
+static uint8_t hidDevicesFound = 0; // in the current full scan
+static ScanCandidates candidates;  // HID advertisers of the current full scan
+static ScanCandidates standby;     // HID advertisers heard while linked, for failover
 
-// TFT Display
-TFT_eSPI tft = TFT_eSPI();
+// USB HID
+USBHID HID;
+ProxyHIDDevice proxyDevice;
+static volatile bool usbReady = false;       // mounted by the host
+static volatile bool usbSynthesized = false; // serving bootReportDescriptor
+
+// Report maps of all peers merged into the descriptor served over USB
+static CompositeDescriptor composite;
 
-// Custom USB HID device to use dynamic report descriptor
-class ProxyHIDDevice : public USBHIDDevice
+// Forward declarations
+void subscribeToReports(Peer &peer, PeerCacheEntry &cache);
+void startScan();
+void startReconnectScan();
+void startBackgroundScan();
+void startAdvertising();
+
+Peer *findPeer(NimBLEClient *client)
 {
-public:
-  ProxyHIDDevice()
+  if (!client)
+    return nullptr;
+
+  for (Peer &peer : peers)
   {
-    _descriptor = nullptr;
-    _descriptorSize = 0;
+    if (peer.client == client)
+      return &peer;
   }
+  return nullptr;
+}
+
+// Slot for a newly found device: the one that last held it, else an unused
+// one, else one whose device is gone. nullptr if it is already connected or
+// pending, or if every slot is taken.
+Peer *allocatePeer(const NimBLEAddress &address)
+{
+  Peer *unused = nullptr;
+  Peer *idle = nullptr;
 
-  void setDescriptor(const uint8_t *desc, uint16_t len)
+  for (Peer &peer : peers)
   {
-    _descriptor = desc;
-    _descriptorSize = len;
+    bool busy = peer.state != PEER_IDLE || peer.advDevice;
+    if (peer.address == address || peer.identity == address)
+      return busy ? nullptr : &peer;
+
+    if (busy)
+      continue;
+    if (!peer.reportMapSize && !unused)
+      unused = &peer;
+    else if (!idle)
+      idle = &peer;
   }
 
-  uint16_t _onGetDescriptor(uint8_t *buffer) override
+  Peer *peer = unused ? unused : idle;
+  if (peer)
+    peer->address = address;
+  return peer;
+}
+
+Peer *findPeerByConnHandle(uint16_t connHandle)
+{
+  for (Peer &peer : peers)
   {
-    if (_descriptor && _descriptorSize > 0)
-    {
-      memcpy(buffer, _descriptor, _descriptorSize);
-      return _descriptorSize;
-    }
-    return 0;
+    if (peer.connected && peer.connHandle == connHandle)
+      return &peer;
   }
+  return nullptr;
+}
 
-private:
-  const uint8_t *_descriptor;
-  uint16_t _descriptorSize;
-};
+void setPeerState(Peer &peer, PeerState state)
+{
+  peer.state = state;
+  peer.stateSince = millis();
+  statusDisplay.setPeerState(&peer - peers, state);
+
+  if (state == PEER_READY)
+    healthMonitor.onPeerReady(&peer - peers);
+  else if (state == PEER_IDLE)
+    healthMonitor.onPeerDisconnected(&peer - peers);
+
+  // A keyboard that just (re)connected gets the host's current LED state
+  if (state == PEER_READY)
+    outputRelay.resync();
+}
 
-// USB HID
-USBHID HID;
-ProxyHIDDevice proxyDevice;
-static uint8_t *reportMapData = nullptr;
-static size_t reportMapSize = 0;
-static bool usbReady = false;
-
-// HID report parsing
-struct HIDReportInfo
-{
-  bool hasKeyboard = false;
-  bool hasMouse = false;
-  bool hasConsumer = false;
-  uint8_t keyboardReportId = 0;
-  uint8_t mouseReportId = 0;
-  uint8_t consumerReportId = 0;
-};
+// True if a bonded peer with this identity is linked or being linked
+bool identityActive(const NimBLEAddress &identity)
+{
+  for (Peer &peer : peers)
+  {
+    if (peer.state != PEER_IDLE && peer.identity == identity)
+      return true;
+  }
+  return false;
+}
 
-// Forward declarations
-void connectToDevice();
-void subscribeToReports(NimBLEClient *client);
-HIDReportInfo parseReportMap(const uint8_t *data, size_t len);
-void startAdvertising();
+// Number of bonded peers that are not linked
+int bondsAway()
+{
+  int away = 0;
+  for (int i = 0; i < NimBLEDevice::getNumBonds(); i++)
+  {
+    if (!identityActive(NimBLEDevice::getBondedAddress(i)))
+      away++;
+  }
+  return away;
+}
 
-void clearDisplay()
+// Adds every bond to the controller whitelist and returns how many bonded
+// peers are not linked. Must not run while a whitelist scan is active.
+int syncWhiteList()
 {
-  tft.fillScreen(TFT_BLACK);
-  tft.setCursor(0, 0);
+  for (int i = 0; i < NimBLEDevice::getNumBonds(); i++)
+  {
+    NimBLEAddress identity = NimBLEDevice::getBondedAddress(i);
+    if (!NimBLEDevice::onWhiteList(identity) && !NimBLEDevice::whiteListAdd(identity))
+      LOGW("Failed to whitelist %s\n", identity.toString().c_str());
+  }
+  return bondsAway();
 }
 
-// Notification callback for HID reports
-void notifyCallback(NimBLERemoteCharacteristic *pChar, uint8_t *pData, size_t length, bool isNotify)
+// True if the address belongs to a slot, linked or not
+bool isPeerAddress(const NimBLEAddress &address)
 {
-  Serial.printf("[%s] %s Report, Len: %d, Data: ",
-                pClient ? pClient->getPeerAddress().toString().c_str() : "??:??:??:??:??:??",
-                isNotify ? "INPUT" : "INDICATE", length);
-  for (size_t i = 0; i < length; i++)
-    Serial.printf("%02X ", pData[i]);
-  Serial.println();
+  for (Peer &peer : peers)
+  {
+    if (peer.address == address || peer.identity == address)
+      return true;
+  }
+  return false;
+}
 
-  // Forward the raw report to USB HID
-  if (usbReady && length > 0)
+// True while any slot is linked, linking or has a device waiting to connect
+bool anyPeerActive()
+{
+  for (Peer &peer : peers)
   {
-    uint8_t reportId = 0;
-    const uint8_t *reportData = pData;
-    size_t reportLen = length;
+    if (peer.state != PEER_IDLE || peer.advDevice)
+      return true;
+  }
+  return false;
+}
 
-    // Heuristic detection based on common report formats:
-    // Keyboard: 8 bytes (modifier, reserved, key1-6)
-    // Mouse: 3-5 bytes (buttons, x, y, [wheel], [pan])
-    if (length == 8)
-    {
-      reportId = HID_REPORT_ID_KEYBOARD;
-      Serial.println("Detected as keyboard report");
-    }
-    else if (length >= 3 && length <= 5)
-    {
-      reportId = HID_REPORT_ID_MOUSE;
-      Serial.println("Detected as mouse report");
-    }
-    else if (length == 2)
-    {
-      reportId = HID_REPORT_ID_CONSUMER_CONTROL;
-      Serial.println("Detected as consumer control report");
-    }
-    else
+// Forwards one HID input report received from a peer. The payload is copied
+// once, from the NimBLE mbuf straight into a slot of the peer's static ring;
+// nothing on this path allocates.
+void forwardReport(Peer &peer, const ReportBinding &binding, os_mbuf *om, size_t length,
+                   bool isNotify, uint32_t rxUs)
+{
+  // Hot path: only deferred tracing and verbose (normally compiled out) logging
+  LOGV("%s Report, handle: 0x%04X, Len: %d\n",
+       isNotify ? "INPUT" : "INDICATE", binding.handle, length);
+
+  if (!usbReady || length == 0 || length > REPORT_SLOT_SIZE)
+    return;
+
+  // BLE notifications carry no report ID; it comes from the characteristic's
+  // Report Reference, fall back to the payload length if it had none
+  const HIDReportLayout *layout = binding.layout ? binding.layout : peer.reportMap.findInputByLength(length);
+  if (!layout)
+  {
+    TRACE_BLE(TRACE_REPORT_UNKNOWN, 0, nullptr, length);
+    LOGV("WARNING: No input report of length %d in report map\n", length);
+    return;
+  }
+
+#if PROXY_SEQ_CHECK
+  if (layout->kind == HID_KIND_VENDOR)
+  {
+    uint8_t header[LOADGEN_HEADER_LENGTH];
+    if (length >= sizeof(header) && os_mbuf_copydata(om, 0, sizeof(header), header) == 0)
+      seqCheck.onReport(&peer - peers, header, sizeof(header), rxUs);
+  }
+#endif
+
+  if (peer.transform.drops(layout->id))
+  {
+    TRACE_BLE(TRACE_REPORT_FILTERED, layout->id, nullptr, length);
+    return;
+  }
+
+  // Report ID in the composite USB descriptor
+  uint8_t usbReportId = peer.usbReportIds[layout->id];
+  if (usbReportId == 0)
+  {
+    TRACE_BLE(TRACE_REPORT_UNMAPPED, layout->id, nullptr, length);
+    return;
+  }
+
+  LOGV("Detected as %s report, ID: %d -> USB ID: %d\n",
+       HIDReportMap::kindName(layout->kind), layout->id, usbReportId);
+
+  // Hand off to the USB task; never block the NimBLE host task on the endpoint
+  uint8_t peerIndex = &peer - peers;
+  ReportSlot *slot = usbForwarder.beginReport(peerIndex, usbReportId);
+  if (!slot)
+  {
+    TRACE_BLE(TRACE_REPORT_DROP, usbReportId, nullptr, length);
+    return;
+  }
+
+  if (usbSynthesized)
+  {
+    // Translated from a stack copy; the slot gets the synthesized report
+    uint8_t raw[REPORT_SLOT_SIZE];
+    if (os_mbuf_copydata(om, 0, length, raw) != 0)
+      return;
+    peer.transform.apply(layout->id, raw, length);
+    length = peer.boot.translate(layout->id, raw, length, slot->data);
+    if (length == 0)
+      return;
+
+    // Peers share the synthesized report IDs: send what all of them hold
+    for (Peer &other : peers)
     {
-      // Unknown report type, check if first byte is a report ID
-      if (pData[0] > 0 && pData[0] <= 7)
-      {
-        reportId = pData[0];
-        reportData = pData + 1;
-        reportLen = length - 1;
-        Serial.printf("Using embedded report ID: %d\n", reportId);
-      }
-      else
-        Serial.println("WARNING: Unknown report format, sending as report ID 0");
+      if (&other != &peer && other.state == PEER_READY)
+        other.boot.mergeHeld(usbReportId, slot->data);
     }
+  }
+  else
+  {
+    if (os_mbuf_copydata(om, 0, length, slot->data) != 0)
+      return;
+    peer.transform.apply(layout->id, slot->data, length);
+  }
+
+  slot->rxUs = rxUs;
+  slot->reportId = usbReportId;
+  slot->length = length;
+  TRACE_BLE(TRACE_REPORT_RX, usbReportId, slot->data, length);
+  usbForwarder.commitReport(peerIndex);
+}
+
+// Battery level notification
+void onBatteryLevel(Peer &peer, uint8_t level)
+{
+  LOGI("[BATTERY] Level: %d%%\n", level);
+  statusDisplay.setPeerBattery(&peer - peers, level);
+  deviceInfo.setBattery(&peer - peers, level);
+}
 
-    bool success = HID.SendReport(reportId, reportData, reportLen);
-    Serial.printf("SendReport(id=%d, len=%d) -> %s\n", reportId, reportLen, success ? "OK" : "FAILED");
+// Reports subscription waits for this: both the stored-key path and full
+// pairing end with an encryption change. NimBLE host task.
+void onEncryptionChange(uint16_t connHandle, int status)
+{
+  Peer *peer = findPeerByConnHandle(connHandle);
+  if (!peer)
+    return;
+
+  uint8_t index = peer - peers;
+  pairingStats.complete(index, status == 0);
+  if (status == 0)
+    postEvent(EVENT_SECURED, index, SECURE_OK);
+  else if (status == BLE_HS_ERR_HCI_BASE + BLE_ERR_PINKEY_MISSING)
+    postEvent(EVENT_SECURED, index, SECURE_KEY_MISSING);
+  else
+    postEvent(EVENT_SECURED, index, SECURE_FAILED);
+}
+
+// All peer notifications arrive here, straight from the GAP event, whether
+// the handles came from discovery or from the cache. Runs on the NimBLE host task.
+int gapEventHandler(ble_gap_event *event, void *arg)
+{
+  if (event->type == BLE_GAP_EVENT_ENC_CHANGE)
+  {
+    onEncryptionChange(event->enc_change.conn_handle, event->enc_change.status);
+    return 0;
+  }
+  if (event->type != BLE_GAP_EVENT_NOTIFY_RX)
+    return 0;
+
+  uint32_t rxUs = LATENCY_STAMP();
+  powerManager.onActivity();
+
+  Peer *peer = findPeerByConnHandle(event->notify_rx.conn_handle);
+  if (!peer)
+    return 0;
+
+  uint16_t handle = event->notify_rx.attr_handle;
+  uint16_t length = OS_MBUF_PKTLEN(event->notify_rx.om);
+
+  if (handle == peer->batteryHandle)
+  {
+    uint8_t level;
+    if (length > 0 && os_mbuf_copydata(event->notify_rx.om, 0, 1, &level) == 0)
+      onBatteryLevel(*peer, level);
+    return 0;
+  }
+
+  const ReportBinding *binding = peer->bindings.find(handle);
+  if (!binding)
+  {
+    // Reports arriving where none are expected mean the subscriptions went stale
+    healthMonitor.onUnboundNotify(peer - peers);
+    return 0;
   }
+
+  if (connTuner.onReport(peer - peers) && !postEvent(EVENT_PEER_ACTIVE, peer - peers))
+    connTuner.activationDropped(peer - peers);
+
+  forwardReport(*peer, *binding, event->notify_rx.om, length, !event->notify_rx.indication, rxUs);
+  return 0;
 }
 
-// Battery level notification callback
-void batteryNotifyCallback(NimBLERemoteCharacteristic *pChar, uint8_t *pData, size_t length, bool isNotify)
+// Result of a CCCD write issued from cached handles
+int cccdWriteCallback(uint16_t connHandle, const ble_gatt_error *error, ble_gatt_attr *attr, void *arg)
 {
-  if (length > 0)
+  if (error->status != 0)
   {
-    Serial.printf("[BATTERY] Level: %d%%\n", pData[0]);
-    tft.printf("BATT: %d%%\n", pData[0]);
+    // Stale handles; rediscover on the next connection
+    Peer *peer = findPeerByConnHandle(connHandle);
+    if (peer && !peer->cacheInvalid)
+    {
+      peer->cacheInvalid = true;
+      postEvent(EVENT_CACHE_INVALID, peer - peers);
+    }
   }
+  return 0;
 }
 
 // Client callbacks
@@ -162,404 +419,1236 @@ class ClientCallbacks : public NimBLEClientCallbacks
 {
   void onConnect(NimBLEClient *pClient) override
   {
-    Serial.printf("[%s] Connected!\n", pClient->getPeerAddress().toString().c_str());
-
-    clearDisplay();
-    tft.setTextColor(TFT_GREEN);
-    tft.printf("CONNECTED to %s\n",
-               pClient->getPeerAddress().toString().c_str());
-    tft.setTextColor(TFT_WHITE);
+    LOGI("[%s] Connected!\n", pClient->getPeerAddress().toString().c_str());
+    statusDisplay.setPhase(UI_CONNECTED);
 
-    deviceConnected = true;
+    Peer *peer = findPeer(pClient);
+    if (peer)
+    {
+      peer->connHandle = pClient->getConnHandle();
+      peer->connected = true;
+
+      // Start encryption right here rather than a queue hop later. For a
+      // bonded peer the host encrypts with the stored LTK, no pairing.
+      NimBLEAddress identity(pClient->getConnInfo().getIdAddress());
+      SecurityPath path = NimBLEDevice::isBonded(identity) ? SECURITY_RESUMED : SECURITY_PAIRED;
+      pairingStats.begin(peer - peers, path);
+      peer->securing = ble_gap_security_initiate(peer->connHandle) == 0;
+      postEvent(EVENT_CONNECTED, peer - peers);
+    }
 
     NimBLEDevice::stopAdvertising();
   }
 
   void onDisconnect(NimBLEClient *pClient, int reason) override
   {
-    Serial.printf("[%s] Disconnected, reason: %d\n",
-                  pClient->getPeerAddress().toString().c_str(), reason);
-
-    clearDisplay();
-    tft.setTextColor(TFT_RED);
-    tft.drawCentreString("DISCONNECTED", tft.width() / 2, tft.height() / 2, 1);
-    tft.setTextColor(TFT_WHITE);
+    LOGI("[%s] Disconnected, reason: %d\n",
+         pClient->getPeerAddress().toString().c_str(), reason);
+    statusDisplay.setPhase(UI_DISCONNECTED);
 
-    deviceConnected = false;
+    // loop() may still be using the client; it is deleted there
+    Peer *peer = findPeer(pClient);
+    if (peer)
+    {
+      peer->connected = false;
+      peer->connHandle = BLE_HS_CONN_HANDLE_NONE;
+      postEvent(EVENT_DISCONNECTED, peer - peers, reason);
+    }
+  }
 
-    NimBLEDevice::deleteClient(pClient);
-    pClient = nullptr;
-    delete advDevice;
-    advDevice = nullptr;
-    return;
+  void onConnectFail(NimBLEClient *pClient, int reason) override
+  {
+    Peer *peer = findPeer(pClient);
+    if (peer)
+      postEvent(EVENT_CONNECT_FAILED, peer - peers, reason);
   }
 
   void onConfirmPasskey(NimBLEConnInfo &connInfo, uint32_t passkey) override
   {
-    Serial.printf("Confirm passkey: %06u - accepting\n", passkey);
-
-    tft.setTextColor(TFT_MAGENTA);
-    tft.printf("Passkey: %06u\n", passkey);
-    tft.setTextColor(TFT_WHITE);
+    LOGI("Confirm passkey: %06u - accepting\n", passkey);
+    statusDisplay.setPasskey(passkey);
 
     NimBLEDevice::injectConfirmPasskey(connInfo, true);
   }
 
+  // The result goes to loop() from onEncryptionChange()
   void onAuthenticationComplete(NimBLEConnInfo &connInfo) override
   {
+    statusDisplay.setPasskey(0);
     if (connInfo.isEncrypted())
-      Serial.println("Authentication SUCCESS - connection encrypted");
+      LOGI("Authentication SUCCESS - connection encrypted\n");
     else
-      Serial.println("Authentication FAILED");
+      LOGW("Authentication FAILED\n");
   }
 
   void onIdentity(NimBLEConnInfo &connInfo) override
   {
-    Serial.printf("Peer identity resolved: %s\n",
-                  NimBLEAddress(connInfo.getIdAddress()).toString().c_str());
+    LOGI("Peer identity resolved: %s\n",
+         NimBLEAddress(connInfo.getIdAddress()).toString().c_str());
   }
 };
 
 static ClientCallbacks clientCallbacks;
 
+// Shows an advertiser that was assigned to a slot
+void showPeerFound(Peer &peer, const NimBLEAdvertisedDevice &device)
+{
+  uint8_t index = &peer - peers;
+  if (device.haveName())
+    statusDisplay.setPeerName(index, device.getName().c_str());
+  else if (!peer.reportMapSize)
+    statusDisplay.setPeerName(index, device.getAddress().toString().c_str());
+  statusDisplay.setPeerRssi(index, device.getRSSI());
+}
+
+uint8_t freeSlots()
+{
+  uint8_t count = 0;
+  for (Peer &peer : peers)
+  {
+    if (peer.state == PEER_IDLE && !peer.advDevice)
+      count++;
+  }
+  return count;
+}
+
+// Moves the best ranked candidates into free slots, best first
+void assignCandidates()
+{
+  NimBLEAdvertisedDevice *device;
+  while (freeSlots() > 0 && (device = candidates.takeBest()) != nullptr)
+  {
+    Peer *peer = allocatePeer(device->getAddress());
+    if (!peer)
+    {
+      delete device;
+      continue;
+    }
+    peer->advDevice = device;
+    showPeerFound(*peer, *device);
+  }
+  candidates.clear();
+}
+
+// Moves standby devices from the background scan into free slots, so a
+// failover connects without a discovery scan. Returns how many were assigned.
+uint8_t assignStandby()
+{
+  standby.expire(STANDBY_MAX_AGE);
+
+  uint8_t assigned = 0;
+  NimBLEAdvertisedDevice *device;
+  while (freeSlots() > 0 && (device = standby.takeBest()) != nullptr)
+  {
+    Peer *peer = allocatePeer(device->getAddress());
+    if (!peer)
+    {
+      delete device;
+      continue;
+    }
+    LOGI("Standby device %s takes slot %d\n", device->getAddress().toString().c_str(), peer - peers);
+    peer->advDevice = device;
+    showPeerFound(*peer, *device);
+    assigned++;
+  }
+  return assigned;
+}
+
+// Ends the scan as soon as a bonded or high-confidence candidate shows up
+void connectEarly(const NimBLEAdvertisedDevice &device)
+{
+  Peer *peer = allocatePeer(device.getAddress());
+  if (!peer)
+    return;
+
+  LOGI("Connecting early to %s\n", device.getAddress().toString().c_str());
+  peer->advDevice = candidates.take(device.getAddress());
+  showPeerFound(*peer, device);
+
+  // Candidates seen so far fill the other slots; scan again if any stay free
+  assignCandidates();
+  fullScanDue = freeSlots() > 0;
+
+  NimBLEDevice::getScan()->stop();
+  postEvent(EVENT_SCAN_END);
+}
+
 // Scan callbacks
 class ScanCallbacks : public NimBLEScanCallbacks
 {
   void onResult(const NimBLEAdvertisedDevice *advertisedDevice) override
   {
-    Serial.printf("Found: %s, RSSI: %d",
-                  advertisedDevice->getAddress().toString().c_str(),
-                  advertisedDevice->getRSSI());
+    LOGD("Found: %s, RSSI: %d",
+         advertisedDevice->getAddress().toString().c_str(),
+         advertisedDevice->getRSSI());
 
     if (advertisedDevice->haveName())
-      Serial.printf(", Name: %s", advertisedDevice->getName().c_str());
+      LOGD(", Name: %s", advertisedDevice->getName().c_str());
 
     if (advertisedDevice->haveAppearance())
-      Serial.printf(", Appearance: 0x%04X", advertisedDevice->getAppearance());
-    Serial.println();
+      LOGD(", Appearance: 0x%04X", advertisedDevice->getAppearance());
+    LOGD("\n");
 
-    // Check if this device has HID service
-    if (advertisedDevice->isAdvertisingService(HID_SERVICE_UUID))
+    // Remember HID devices for failover; never connect from here. Cheap
+    // checks first: most of what a background scan hears is not HID.
+    if (backgroundScan)
     {
-      Serial.println("  -> HID Service found!");
-
-      tft.printf("* %s, RSSI: %d",
-                 advertisedDevice->getAddress().toString().c_str(),
-                 advertisedDevice->getRSSI());
+      if (advertisedDevice->getRSSI() < SCAN_MIN_RSSI || isPeerAddress(advertisedDevice->getAddress()))
+        return;
+      bool hidAppearance = advertisedDevice->haveAppearance() &&
+                           (advertisedDevice->getAppearance() & 0xFFC0) == APPEARANCE_HID_GENERIC;
+      if ((hidAppearance || advertisedDevice->isAdvertisingService(HID_SERVICE_UUID)) &&
+          standby.add(*advertisedDevice))
+        LOGD("  -> standby\n");
+      return;
+    }
 
-      if (advertisedDevice->haveName())
-        tft.printf(", %s", advertisedDevice->getName().c_str());
+    // A whitelist scan only reports bonded peers: connect to the first one
+    // right away instead of waiting for the scan to end
+    if (reconnectScan)
+    {
+      Peer *peer = allocatePeer(advertisedDevice->getAddress());
+      if (peer)
+      {
+        LOGI("Bonded peer %s is back\n", advertisedDevice->getAddress().toString().c_str());
+        peer->advDevice = new NimBLEAdvertisedDevice(*advertisedDevice);
+        showPeerFound(*peer, *advertisedDevice);
+        NimBLEDevice::getScan()->stop();
+        postEvent(EVENT_SCAN_END);
+      }
+      return;
+    }
 
-      tft.println();
+    // Check if this device has HID service
+    if (advertisedDevice->isAdvertisingService(HID_SERVICE_UUID))
+    {
+      LOGD("  -> HID Service found!\n");
+      statusDisplay.setDevicesFound(++hidDevicesFound);
 
-      if (advDevice == nullptr)
-        advDevice = new NimBLEAdvertisedDevice(*advertisedDevice);
+      const ScanCandidate *candidate = candidates.add(*advertisedDevice);
+      if (candidate && candidate->confident)
+        connectEarly(*advertisedDevice);
     }
   }
 
   void onScanEnd(const NimBLEScanResults &results, int reason) override
   {
-    Serial.printf("Scan complete, found %d devices\n", results.getCount());
+    if (backgroundScan)
+    {
+      LOGD("Background scan ended, %d standby devices\n", standby.count());
+      postEvent(EVENT_SCAN_END);
+      return;
+    }
 
-    tft.setTextColor(TFT_GREEN);
-    tft.printf("Complete, found %d devices\n", results.getCount());
-    tft.setTextColor(TFT_WHITE);
+    if (reconnectScan)
+    {
+      // Fall back to a full scan once the bonded peers had their chance
+      if (!anyPeerActive())
+        fullScanDue = true;
+      postEvent(EVENT_SCAN_END);
+      return;
+    }
 
-    if (advDevice != nullptr && !doConnect)
-      doConnect = true;
+    LOGI("Scan complete, found %d devices\n", results.getCount());
+
+    assignCandidates();
+    postEvent(EVENT_SCAN_END);
   }
 };
 
 static ScanCallbacks scanCallbacks;
 
-void printDeviceInfo(NimBLEClient *client)
+// Long read of the report map straight into the peer's static buffer: no
+// NimBLEAttValue heap copy, and a map larger than the buffer is cut off at
+// the first chunk that does not fit. The read runs in the background; its
+// end arrives in loop() as EVENT_REPORT_MAP_READ.
+#define REPORT_MAP_READ_TIMEOUT 10000
+
+struct ReportMapRead
 {
-  Serial.println("\n========== Device Information ==========");
-  Serial.printf("Address: %s\n", client->getPeerAddress().toString().c_str());
+  uint16_t connHandle;
+  uint32_t generation; // passed as arg; a read that timed out no longer matches
+  size_t length;
+  int status;
+  bool pending; // chunks still expected
+  bool done;    // ended, result not taken by loop() yet
+};
+
+// One read per peer; arg carries the generation and the peer index
+static ReportMapRead reportMapReads[PROXY_MAX_PEERS];
+static uint32_t reportMapGeneration = 0;
+static portMUX_TYPE reportMapReadLock = portMUX_INITIALIZER_UNLOCKED;
 
-  // Get Device Name
-  NimBLERemoteService *gapSvc = client->getService(GAP_SERVICE_UUID);
-  if (gapSvc)
+// NimBLE host task, once per ATT Read (Blob) response and once at the end
+static int onReportMapChunk(uint16_t connHandle, const struct ble_gatt_error *error,
+                            struct ble_gatt_attr *attr, void *arg)
+{
+  uint32_t tag = (uint32_t)(uintptr_t)arg;
+  uint8_t index = tag % PROXY_MAX_PEERS;
+  ReportMapRead &read = reportMapReads[index];
+  int status = error->status;
+
+  // Chunks are at most one ATT MTU, short enough to copy under the lock
+  portENTER_CRITICAL(&reportMapReadLock);
+  if (tag / PROXY_MAX_PEERS != read.generation || connHandle != read.connHandle || !read.pending)
   {
-    NimBLERemoteCharacteristic *nameChar = gapSvc->getCharacteristic(DEVICE_NAME_UUID);
-    if (nameChar && nameChar->canRead())
+    // loop() gave up on this read; its buffer may belong to the next one
+    portEXIT_CRITICAL(&reportMapReadLock);
+    return BLE_HS_EAPP;
+  }
+
+  if (status == 0)
+  {
+    uint16_t chunk = OS_MBUF_PKTLEN(attr->om);
+    if (attr->offset + chunk > PEER_REPORT_MAP_CAPACITY)
+      status = BLE_HS_EMSGSIZE; // returning non-zero ends the procedure without a final call
+    else
     {
-      Serial.printf("Device Name: %s\n", nameChar->readValue().c_str());
-      tft.printf("NAME: %s\n", nameChar->readValue().c_str());
+      os_mbuf_copydata(attr->om, 0, chunk, peers[index].reportMapData + attr->offset);
+      read.length = attr->offset + chunk;
+      portEXIT_CRITICAL(&reportMapReadLock);
+      return 0;
     }
   }
 
-  // Get Device Information Service
-  NimBLERemoteService *devInfoSvc = client->getService(DEVICE_INFO_UUID);
-  if (devInfoSvc)
+  read.status = status == BLE_HS_EDONE ? 0 : status;
+  read.pending = false;
+  read.done = true;
+  int rc = read.status;
+  portEXIT_CRITICAL(&reportMapReadLock);
+
+  // A dropped event is picked up by checkReportMapRead()
+  postEvent(EVENT_REPORT_MAP_READ, index);
+  return rc;
+}
+
+// Starts the long read of the report map; false if the peer has none
+static bool startReportMapRead(Peer &peer)
+{
+  NimBLERemoteService *hidSvc = peer.client->getService(HID_SERVICE_UUID);
+  NimBLERemoteCharacteristic *reportMapChar = hidSvc ? hidSvc->getCharacteristic(HID_REPORT_MAP_UUID) : nullptr;
+  if (!reportMapChar || !reportMapChar->canRead())
+    return false;
+
+  uint8_t index = &peer - peers;
+  peer.reportMapSize = 0;
+  peer.transform.clear();
+  peer.boot.clear();
+
+  portENTER_CRITICAL(&reportMapReadLock);
+  uint32_t generation = ++reportMapGeneration;
+  reportMapReads[index] = {peer.connHandle, generation, 0, 0, true, false};
+  portEXIT_CRITICAL(&reportMapReadLock);
+
+  uint32_t tag = generation * PROXY_MAX_PEERS + index;
+  if (ble_gattc_read_long(peer.connHandle, reportMapChar->getHandle(), 0, onReportMapChunk,
+                          (void *)(uintptr_t)tag) == 0)
+    return true;
+
+  portENTER_CRITICAL(&reportMapReadLock);
+  reportMapReads[index].pending = false;
+  portEXIT_CRITICAL(&reportMapReadLock);
+  return false;
+}
+
+// Takes the result of an ended read: the map length, or 0 if the read
+// failed or the map did not fit. False if no result is waiting.
+static bool takeReportMapRead(Peer &peer, size_t &length)
+{
+  ReportMapRead &read = reportMapReads[&peer - peers];
+
+  portENTER_CRITICAL(&reportMapReadLock);
+  bool done = read.done;
+  read.done = false;
+  int status = read.status;
+  length = read.length;
+  portEXIT_CRITICAL(&reportMapReadLock);
+  if (!done)
+    return false;
+
+  if (status == BLE_HS_EMSGSIZE)
+    LOGE("Report map exceeds %d bytes, not exposed\n", PEER_REPORT_MAP_CAPACITY);
+  else if (status != 0)
+    LOGE("Report map read failed (%d)\n", status);
+  if (status != 0)
+    length = 0;
+  return true;
+}
+
+// Parses the peer's report map and compiles the stages built on it
+void compileReportMap(Peer &peer)
+{
+  if (!peer.reportMap.parse(peer.reportMapData, peer.reportMapSize))
+    LOGW("Report map parse error, layout table may be incomplete\n");
+  peer.transform.compile(peer.reportMap, transformConfig);
+  peer.boot.compile(peer.reportMap);
+}
+
+// Parses the report map just read: the only GATT read needed before
+// reports can flow. Informational reads are left to deviceInfo.
+void parseReportMap(Peer &peer, size_t length)
+{
+  LOGI("\n============== Report Map ==============\n");
+  LOGI("Address: %s\n", peer.address.toString().c_str());
+
+  peer.reportMapSize = length;
+  if (length)
   {
-    NimBLERemoteCharacteristic *manufChar = devInfoSvc->getCharacteristic(MANUFACTURER_NAME_UUID);
-    if (manufChar && manufChar->canRead())
+    LOGI("Report Map Length: %d bytes\n", peer.reportMapSize);
+
+    HIDReportMap &reportMap = peer.reportMap;
+    compileReportMap(peer);
+
+    for (size_t i = 0; i < reportMap.reportCount(); i++)
     {
-      Serial.printf("Manufacturer: %s\n", manufChar->readValue().c_str());
-      tft.printf("MANU: %s\n", manufChar->readValue().c_str());
+      const HIDReportLayout &report = reportMap.report(i);
+      LOGI("  Report ID %d: %s %s, %d bytes, %d fields\n", report.id,
+           HIDReportMap::kindName(report.kind), HIDReportMap::typeName(report.type),
+           report.byteLength(), report.fieldCount);
+      if (report.type == HID_REPORT_INPUT && reportMap.isLengthAmbiguous(report.byteLength()))
+        LOGW("  WARNING: input length %d is shared by several reports\n", report.byteLength());
     }
 
-    NimBLERemoteCharacteristic *pnpChar = devInfoSvc->getCharacteristic(PNP_ID_UUID);
-    if (pnpChar && pnpChar->canRead())
+#if PROXY_LOG_LEVEL >= PROXY_LOG_DEBUG
+    // Print the report map in hex for debugging
+    LOGD("Report Map (hex):\n");
+    for (size_t i = 0; i < peer.reportMapSize; i++)
     {
-      NimBLEAttValue val = pnpChar->readValue();
-      if (val.size() >= 7)
-      {
-        const uint8_t *data = val.data();
-        uint16_t vid = data[1] | (data[2] << 8);
-        uint16_t pid = data[3] | (data[4] << 8);
-        uint16_t ver = data[5] | (data[6] << 8);
-        Serial.printf("VID: 0x%04X, PID: 0x%04X, Version: 0x%04X\n", vid, pid, ver);
-        tft.printf("VID: 0x%04X, PID: 0x%04X, VER: 0x%04X\n", vid, pid, ver);
-      }
+      LOGD("%02X ", peer.reportMapData[i]);
+      if ((i + 1) % 16 == 0)
+        LOGD("\n");
     }
+    if (peer.reportMapSize % 16 != 0)
+      LOGD("\n");
+#endif
   }
+  LOGI("=========================================\n\n");
+}
+
+// Enables battery notifications; the level itself is read by deviceInfo
+void subscribeToBattery(Peer &peer, PeerCacheEntry &cache)
+{
+  NimBLERemoteService *battSvc = peer.client->getService(BATTERY_SERVICE_UUID);
+  NimBLERemoteCharacteristic *battChar = battSvc ? battSvc->getCharacteristic(BATTERY_LEVEL_UUID) : nullptr;
 
-  // Get Battery Level
-  NimBLERemoteService *battSvc = client->getService(BATTERY_SERVICE_UUID);
-  if (battSvc)
+  // Notifications are dispatched by gapEventHandler
+  if (battChar && battChar->canNotify() && battChar->subscribe(true))
   {
-    NimBLERemoteCharacteristic *battChar = battSvc->getCharacteristic(BATTERY_LEVEL_UUID);
-    if (battChar && battChar->canRead())
-    {
-      uint8_t level = battChar->readValue<uint8_t>();
-      Serial.printf("Battery: %d%%\n", level);
-      tft.printf("BATT: %d%%\n", level);
+    peer.batteryHandle = battChar->getHandle();
+    NimBLERemoteDescriptor *cccd = battChar->getDescriptor(CCCD_UUID);
+    cache.batteryHandle = peer.batteryHandle;
+    cache.batteryCccdHandle = cccd ? cccd->getHandle() : 0;
+  }
+}
 
-      if (battChar->canNotify())
-        battChar->subscribe(true, batteryNotifyCallback);
-    }
+void subscribeToReports(Peer &peer, PeerCacheEntry &cache)
+{
+  NimBLERemoteService *hidSvc = peer.client->getService(HID_SERVICE_UUID);
+  if (!hidSvc)
+  {
+    LOGE("HID Service not found!\n");
+    return;
   }
 
-  // Get HID Information
-  NimBLERemoteService *hidSvc = client->getService(HID_SERVICE_UUID);
-  if (hidSvc)
+  // Get all characteristics and subscribe to report characteristics
+  std::vector<NimBLERemoteCharacteristic *> chars = hidSvc->getCharacteristics(true);
+  int reportCount = 0;
+
+  peer.bindings.clear();
+
+  for (auto chr : chars)
   {
-    NimBLERemoteCharacteristic *hidInfoChar = hidSvc->getCharacteristic(HID_INFO_UUID);
-    if (hidInfoChar && hidInfoChar->canRead())
+    if (chr->getUUID() != HID_REPORT_UUID)
+      continue;
+
+    // Report Reference: [report ID, report type (1 input, 2 output, 3 feature)]
+    uint8_t reportId = 0;
+    uint8_t type = HID_REPORT_INPUT;
+    const HIDReportLayout *layout = nullptr;
+
+    NimBLERemoteDescriptor *refDesc = chr->getDescriptor(HID_REPORT_REFERENCE_UUID);
+    if (refDesc)
     {
-      NimBLEAttValue val = hidInfoChar->readValue();
-      if (val.size() >= 4)
+      NimBLEAttValue ref = refDesc->readValue();
+      const uint8_t *refData = ref.data();
+      if (ref.size() >= 2 && refData[1] >= 1 && refData[1] <= HID_REPORT_TYPES)
       {
-        const uint8_t *data = val.data();
-        Serial.printf("HID Version: %d.%d, Country: %d, Flags: 0x%02X\n",
-                      data[0], data[1], data[2], data[3]);
+        reportId = refData[0];
+        type = refData[1] - 1;
+        layout = peer.reportMap.find(type, reportId);
+
+        LOGI("Report characteristic 0x%04X: ID %d, %s, %d bytes%s\n",
+             chr->getHandle(), reportId, HIDReportMap::typeName(type),
+             layout ? layout->byteLength() : 0, layout ? "" : " (not in report map)");
       }
     }
 
-    // Print Report Map
-    NimBLERemoteCharacteristic *reportMapChar = hidSvc->getCharacteristic(HID_REPORT_MAP_UUID);
-    if (reportMapChar && reportMapChar->canRead())
-    {
-      NimBLEAttValue val = reportMapChar->readValue();
-      Serial.printf("Report Map Length: %d bytes\n", val.size());
-
-      // Store the report map for USB HID
-      if (reportMapData)
-        delete[] reportMapData;
+    // Without a layout the notification path falls back to the payload length
+    peer.bindings.add(chr->getHandle(), reportId, type, layout);
 
-      reportMapSize = val.size();
-      reportMapData = new uint8_t[reportMapSize];
-      memcpy(reportMapData, val.data(), reportMapSize);
+    CachedReport *cached = cache.reportCount < MAX_REPORT_BINDINGS ? &cache.reports[cache.reportCount++] : nullptr;
+    if (cached)
+    {
+      cached->handle = chr->getHandle();
+      cached->reportId = reportId;
+      cached->type = type;
+    }
 
-      // Print the report map in hex for debugging
-      Serial.println("Report Map (hex):");
-      for (size_t i = 0; i < reportMapSize; i++)
+    if (chr->canNotify() || chr->canIndicate())
+    {
+      // Notifications are dispatched by gapEventHandler
+      if (chr->subscribe(chr->canNotify()))
       {
-        Serial.printf("%02X ", reportMapData[i]);
-        if ((i + 1) % 16 == 0)
-          Serial.println();
+        reportCount++;
+        LOGI("Subscribed to Report characteristic (handle: 0x%04X)\n",
+             chr->getHandle());
+
+        NimBLERemoteDescriptor *cccd = chr->getDescriptor(CCCD_UUID);
+        if (cached && cccd)
+        {
+          cached->cccdHandle = cccd->getHandle();
+          cached->indicate = !chr->canNotify();
+        }
       }
-      if (reportMapSize % 16 != 0)
-        Serial.println();
     }
   }
-  Serial.println("=========================================\n");
+
+  LOGI("Subscribed to %d HID Report(s)\n", reportCount);
 }
 
-void subscribeToReports(NimBLEClient *client)
+// Merges the report maps of all known peers, linked or not, into the USB
+// descriptor. Maps go in identity order, so the descriptor and its report
+// IDs do not depend on which slot a peer got or which one connected first.
+void updateUsbDescriptor()
 {
-  NimBLERemoteService *hidSvc = client->getService(HID_SERVICE_UUID);
-  if (!hidSvc)
+  bool synthesize = PROXY_USB_MODE == USB_MODE_BOOT;
+
+  Peer *order[PROXY_MAX_PEERS];
+  size_t mapCount = 0;
+  for (Peer &peer : peers)
+  {
+    if (!peer.reportMapSize)
+      continue;
+    size_t i = mapCount++;
+    for (; i > 0 && (uint64_t)order[i - 1]->identity > (uint64_t)peer.identity; i--)
+      order[i] = order[i - 1];
+    order[i] = &peer;
+  }
+
+  composite.clear();
+  for (size_t i = 0; i < mapCount; i++)
   {
-    Serial.println("HID Service not found!");
+    Peer &peer = *order[i];
+    if (!synthesize && !composite.append(peer.reportMapData, peer.reportMapSize, peer.usbReportIds))
+    {
+      LOGW("Report map of %s does not fit the USB descriptor, using the boot descriptor\n",
+           peer.address.toString().c_str());
+      synthesize = true;
+    }
+  }
+
+  if (mapCount == 0)
+  {
+    LOGE("ERROR: No report map data available!\n");
     return;
   }
 
-  // Get all characteristics and subscribe to report characteristics
-  std::vector<NimBLERemoteCharacteristic *> chars = hidSvc->getCharacteristics(true);
-  int reportCount = 0;
+  const uint8_t *descriptor = composite.data();
+  size_t descriptorSize = composite.size();
+  if (synthesize)
+  {
+    for (Peer &peer : peers)
+    {
+      for (int id = 0; id < 256; id++)
+        peer.usbReportIds[id] = peer.reportMapSize ? peer.boot.targetId(id) : 0;
+    }
+    descriptor = bootReportDescriptor;
+    descriptorSize = bootReportDescriptorSize;
+    LOGI("Synthesized boot report map: %d bytes\n", descriptorSize);
+  }
+  else
+    LOGI("Composite report map: %d bytes\n", descriptorSize);
 
-  for (auto chr : chars)
+  // Reconnecting the same peers yields the same descriptor: USB stays attached
+  usbSynthesized = synthesize;
+  usbForwarder.setReportMap(descriptor, descriptorSize);
+  proxyDevice.setDescriptor(descriptor, descriptorSize);
+}
+
+// Brings USB up once, at boot. The composite of the peers restored from
+// PeerCache is enumerated right away; without any, the descriptor served
+// before the last reboot (the synthesized one on first boot). Peers only
+// cause a re-attach if their composite differs from it.
+void startUsb(bool restored)
+{
+  if (proxyDevice.loadCached())
+    LOGI("Cached USB report map: %d bytes (%08x)\n", proxyDevice.descriptorLength(),
+         proxyDevice.descriptorHash());
+  if (restored)
+    updateUsbDescriptor();
+  else if (!proxyDevice.descriptorLength())
+    proxyDevice.setDescriptor(bootReportDescriptor, bootReportDescriptorSize);
+  usbForwarder.setReportMap(proxyDevice.descriptor(), proxyDevice.descriptorLength());
+
+  bool deviceAdded = proxyDevice.begin();
+  LOGD("addDevice returned: %d\n", deviceAdded);
+
+  HID.begin();
+  LOGD("HID.begin() called\n");
+
+  USB.begin();
+  LOGD("USB.begin() called\n");
+
+  // Forwarding starts once the host has mounted the device, see usbEventCallback
+}
+
+// Enables notifications by writing a cached CCCD handle, no discovery needed
+void writeCachedCccd(Peer &peer, uint16_t cccdHandle, bool indicate)
+{
+  uint8_t value[2] = {(uint8_t)(indicate ? 0x02 : 0x01), 0x00};
+  int rc = ble_gattc_write_flat(peer.connHandle, cccdHandle, value, sizeof(value),
+                                cccdWriteCallback, nullptr);
+  if (rc != 0)
+    peer.cacheInvalid = true;
+}
+
+// Scratch for cache loads, only used from loop()
+static PeerCacheEntry cacheEntry;
+static uint8_t cacheReportMap[PEER_REPORT_MAP_CAPACITY];
+
+// Fills the first slots with the bonded peers cached in NVS, in identity
+// order, so the first descriptor USB serves already covers them. Returns
+// the number of slots filled.
+size_t restorePeers()
+{
+  size_t restored = 0;
+  uint64_t last = 0;
+  bool first = true;
+  while (restored < PROXY_MAX_PEERS)
   {
-    if (chr->getUUID() == HID_REPORT_UUID)
+    // Next bond in identity order
+    NimBLEAddress identity;
+    bool found = false;
+    for (int i = 0; i < NimBLEDevice::getNumBonds(); i++)
     {
-      if (chr->canNotify() || chr->canIndicate())
+      NimBLEAddress bond = NimBLEDevice::getBondedAddress(i);
+      uint64_t key = (uint64_t)bond;
+      if ((first || key > last) && (!found || key < (uint64_t)identity))
       {
-        if (chr->subscribe(true, notifyCallback))
-        {
-          reportCount++;
-          Serial.printf("Subscribed to Report characteristic (handle: 0x%04X)\n",
-                        chr->getHandle());
-        }
+        identity = bond;
+        found = true;
       }
     }
+    if (!found)
+      break;
+    first = false;
+    last = (uint64_t)identity;
+
+    if (!peerCache.load(identity, cacheEntry, cacheReportMap, sizeof(cacheReportMap)))
+      continue;
+
+    Peer &peer = peers[restored++];
+    peer.address = identity;
+    peer.identity = identity;
+    peer.reportMapSize = cacheEntry.reportMapSize;
+    memcpy(peer.reportMapData, cacheReportMap, peer.reportMapSize);
+    compileReportMap(peer);
+    LOGI("Restored %s: %d bytes report map\n", identity.toString().c_str(), peer.reportMapSize);
+  }
+  return restored;
+}
+
+// Restores report map and bindings of a bonded peer from NVS and re-enables
+// its notifications directly. Returns false on a cache miss.
+bool resumeFromCache(Peer &peer)
+{
+  PeerCacheEntry &entry = cacheEntry;
+  if (!peerCache.load(peer.identity, entry, cacheReportMap, sizeof(cacheReportMap)))
+    return false;
+
+  peer.reportMapSize = entry.reportMapSize;
+  memcpy(peer.reportMapData, cacheReportMap, peer.reportMapSize);
+  compileReportMap(peer);
+
+  peer.bindings.clear();
+  for (uint8_t i = 0; i < entry.reportCount; i++)
+  {
+    const CachedReport &report = entry.reports[i];
+    peer.bindings.add(report.handle, report.reportId, report.type,
+                      peer.reportMap.find(report.type, report.reportId));
+  }
+  peer.batteryHandle = entry.batteryHandle;
+
+  // Expose this peer's reports over USB
+  updateUsbDescriptor();
+
+  int reportCount = 0;
+  for (uint8_t i = 0; i < entry.reportCount; i++)
+  {
+    if (entry.reports[i].cccdHandle)
+    {
+      writeCachedCccd(peer, entry.reports[i].cccdHandle, entry.reports[i].indicate);
+      reportCount++;
+    }
   }
+  if (entry.batteryCccdHandle)
+    writeCachedCccd(peer, entry.batteryCccdHandle, false);
 
-  Serial.printf("Subscribed to %d HID Report(s)\n", reportCount);
+  LOGI("Resumed from cache: %d bytes report map, %d HID Report(s)\n",
+       peer.reportMapSize, reportCount);
+  return true;
 }
 
-// Simple HID report map parser (basic implementation)
-HIDReportInfo parseReportMap(const uint8_t *data, size_t len)
+// Rewrites the CCCDs of a linked peer from its cached handles, the cheapest
+// recovery step. Returns false if there is nothing cached to write.
+bool resubscribe(Peer &peer)
 {
-  HIDReportInfo info;
+  if (!peer.connected || !peerCache.load(peer.identity, cacheEntry, cacheReportMap, sizeof(cacheReportMap)))
+    return false;
 
-  // Basic detection based on usage pages
-  // Usage Page 0x01 = Generic Desktop (mouse, keyboard)
-  // Usage Page 0x0C = Consumer devices
-  for (size_t i = 0; i < len - 1; i++)
+  int reportCount = 0;
+  for (uint8_t i = 0; i < cacheEntry.reportCount; i++)
   {
-    // Look for Usage Page markers
-    if (data[i] == 0x05)
+    if (cacheEntry.reports[i].cccdHandle)
     {
-      // Usage Page
-      uint8_t page = data[i + 1];
-      if (page == 0x01)
-      {
-        // Check for keyboard (Usage 0x06) or mouse (Usage 0x02)
-        for (size_t j = i; j < len - 1 && j < i + 20; j++)
-        {
-          if (data[j] == 0x09)
-          {
-            // Usage
-            if (data[j + 1] == 0x06)
-              info.hasKeyboard = true;
-            else if (data[j + 1] == 0x02)
-              info.hasMouse = true;
-          }
-        }
-      }
-      else if (page == 0x0C)
-        info.hasConsumer = true;
+      writeCachedCccd(peer, cacheEntry.reports[i].cccdHandle, cacheEntry.reports[i].indicate);
+      reportCount++;
     }
   }
+  LOGI("Resubscribed to %d HID Report(s) of %s\n", reportCount, peer.identity.toString().c_str());
+  return reportCount > 0;
+}
+
+// Starts an asynchronous connection; the result arrives as EVENT_CONNECTED
+// or EVENT_CONNECT_FAILED
+void startConnect(Peer &peer)
+{
+  LOGI("\nConnecting to: %s\n", peer.advDevice->getAddress().toString().c_str());
+
+  statusDisplay.setPhase(UI_CONNECTING);
+
+  peer.client = NimBLEDevice::createClient();
+  peer.client->setClientCallbacks(&clientCallbacks);
+
+  // Links open fast; ConnTuner relaxes them once the peer goes quiet
+  const ConnParams &params = connTuner.profile().active;
+  peer.client->setConnectionParams(params.minInterval, params.maxInterval,
+                                   params.latency, params.timeout);
+  peer.client->setConnectTimeout(CONNECT_TIMEOUT);
 
-  return info;
+  setPeerState(peer, PEER_CONNECTING);
+  bool started = peer.client->connect(peer.advDevice, true, true);
+
+  delete peer.advDevice;
+  peer.advDevice = nullptr;
+
+  if (!started)
+    postEvent(EVENT_CONNECT_FAILED, &peer - peers, -1);
 }
 
-void connectToDevice()
+// Connects the next slot with a pending device; the controller handles one
+// connection attempt at a time
+void connectNextPending()
 {
-  if (advDevice == nullptr)
+  for (Peer &peer : peers)
+  {
+    if (peer.state == PEER_CONNECTING)
+      return;
+  }
+
+  for (Peer &peer : peers)
+  {
+    if (peer.advDevice && peer.state == PEER_IDLE)
+    {
+      startConnect(peer);
+      return;
+    }
+  }
+}
+
+// True unless a bond that stays away used up its back to back reconnect
+// rounds and the backoff period has not passed yet
+bool reconnectDue()
+{
+  return reconnectRounds < RECONNECT_ROUNDS_LINKED || millis() - lastReconnectMs >= RECONNECT_BACKOFF_MS;
+}
+
+// Rescans as soon as nothing is linked or waiting to link; while other peers
+// are linked, keeps listening for bonded peers that are away and fills free
+// slots from the standby list
+void rescanIfIdle()
+{
+  NimBLEScan *scan = NimBLEDevice::getScan();
+  if (scan->isScanning())
+  {
+    // A slot came free: the background scan makes way for reconnecting
+    // or for a standby device
+    if (backgroundScan && freeSlots() > 0 && (standby.count() > 0 || (bondsAway() > 0 && reconnectDue())))
+    {
+      scan->stop();
+      postEvent(EVENT_SCAN_END);
+    }
     return;
+  }
 
-  Serial.printf("\nConnecting to: %s\n", advDevice->getAddress().toString().c_str());
+  if (!anyPeerActive())
+  {
+    startScan();
+    return;
+  }
+
+  for (Peer &peer : peers)
+  {
+    if (peer.state == PEER_CONNECTING || peer.advDevice)
+      return;
+  }
 
-  clearDisplay();
-  tft.setTextColor(TFT_MAGENTA);
-  tft.drawCentreString("CONNECTING", tft.width() / 2, tft.height() / 2, 1);
-  tft.setTextColor(TFT_WHITE);
+  int away = syncWhiteList();
+  if (away == 0)
+    reconnectRounds = 0;
 
-  pClient = NimBLEDevice::createClient();
-  pClient->setClientCallbacks(&clientCallbacks);
+  // Failover: once a dropped bond had a reconnect round, standby devices the
+  // background scan heard take the free slots
+  if (freeSlots() > 0 && (away == 0 || reconnectRounds > 0) && assignStandby() > 0)
+  {
+    LOGI("Connecting to standby devices\n");
+    connectNextPending();
+    return;
+  }
 
-  // Set connection parameters
-  pClient->setConnectionParams(12, 12, 0, 150);
+  // An early connect cut the last full scan short with slots still free
+  if (fullScanDue)
+    startScan();
+  else if (away > 0 && reconnectDue())
+    startReconnectScan();
+  else
+    startBackgroundScan();
+}
 
-  if (!pClient->connect(advDevice))
+// Exposes the peer's reports over USB and subscribes to them, once its
+// report map read has ended
+void finishSetup(Peer &peer)
+{
+  PeerCacheEntry cache = {};
+
+  // Expose this peer's reports over USB
+  updateUsbDescriptor();
+
+  // Subscribe to HID reports
+  subscribeToReports(peer, cache);
+  subscribeToBattery(peer, cache);
+
+  if (peer.client->getConnInfo().isBonded() && peer.reportMapSize)
   {
-    Serial.println("Connection failed!");
+    cache.version = PEER_CACHE_VERSION;
+    cache.reportMapSize = peer.reportMapSize;
+    peerCache.store(peer.identity, cache, peer.reportMapData);
+  }
+
+  setPeerState(peer, PEER_READY);
+  deviceInfo.start(&peer - peers, peer.client, peer.identity, peer.batteryHandle != 0);
+}
+
+// Starts discovery once the link is encrypted (or encryption has timed out):
+// the report map is read in the background, see finishSetup()
+void setupPeer(Peer &peer)
+{
+  setPeerState(peer, PEER_DISCOVERING);
+  connTuner.reset(&peer - peers);
+
+  NimBLEConnInfo connInfo = peer.client->getConnInfo();
+  peer.identity = connInfo.getIdAddress();
+  peer.cacheInvalid = false;
 
-    clearDisplay();
-    tft.setTextColor(TFT_RED);
-    tft.drawCentreString("CONNECTION FAILED", tft.width() / 2, tft.height() / 2, 1);
-    tft.setTextColor(TFT_WHITE);
+  // A bond that came back under another address than its slot's: that slot
+  // gives way. The descriptor is ordered by identity, so it does not change.
+  for (Peer &other : peers)
+  {
+    if (&other != &peer && other.state == PEER_IDLE && !other.advDevice && other.identity == peer.identity)
+    {
+      other.reportMapSize = 0;
+      other.address = NimBLEAddress();
+      other.identity = NimBLEAddress();
+    }
+  }
 
-    NimBLEDevice::deleteClient(pClient);
-    pClient = nullptr;
-    delete advDevice;
-    advDevice = nullptr;
+  // Bonded peers with cached handles skip discovery entirely
+  if (connInfo.isBonded() && resumeFromCache(peer))
+  {
+    setPeerState(peer, PEER_READY);
+    deviceInfo.start(&peer - peers, peer.client, peer.identity, peer.batteryHandle != 0);
     return;
   }
 
-  Serial.println("Connected, discovering services...");
+  LOGI("Discovering services...\n");
 
-  // Wait for bonding/encryption
-  delay(500);
+  // Report map, USB and report subscriptions first: they gate the first
+  // report. Name, manufacturer, PnP ID and battery level follow later.
+  if (!startReportMapRead(peer))
+  {
+    LOGE("No readable report map\n");
+    finishSetup(peer);
+  }
+}
+
+// Continues setup if the peer's report map read has ended
+void completeReportMapRead(Peer &peer)
+{
+  size_t length;
+  if (peer.state != PEER_DISCOVERING || !takeReportMapRead(peer, length))
+    return;
+  parseReportMap(peer, length);
+  finishSetup(peer);
+}
 
-  // Initiate security/bonding
-  if (!pClient->secureConnection())
-    Serial.println("Security setup failed, continuing anyway...");
+// A read still running after REPORT_MAP_READ_TIMEOUT: the procedure keeps
+// going until the link does, so end both. An ended read whose event was
+// dropped is completed here instead.
+void checkReportMapRead(Peer &peer)
+{
+  if (millis() - peer.stateSince <= REPORT_MAP_READ_TIMEOUT)
+    return;
 
-  // Print device information
-  printDeviceInfo(pClient);
+  portENTER_CRITICAL(&reportMapReadLock);
+  ReportMapRead &read = reportMapReads[&peer - peers];
+  bool pending = read.pending;
+  read.pending = false;
+  portEXIT_CRITICAL(&reportMapReadLock);
 
-  // Initialize USB HID with the report descriptor from the BLE device
-  if (reportMapData && reportMapSize > 0)
+  if (pending)
   {
-    Serial.println("Initializing USB HID with device report map...");
+    LOGE("Report map read timed out, disconnecting\n");
+    peer.client->disconnect();
+  }
+  else
+    completeReportMapRead(peer);
+}
 
-    proxyDevice.setDescriptor(reportMapData, reportMapSize);
+// Writes a host output/feature report to the Report characteristic it maps
+// to on every ready peer. Output reports go out as write-without-response;
+// feature characteristics only accept acknowledged writes.
+void writeOutputReport(uint8_t usbReportId, uint8_t type, const uint8_t *data, size_t length)
+{
+  for (Peer &peer : peers)
+  {
+    if (peer.state != PEER_READY)
+      continue;
 
-    bool deviceAdded = USBHID::addDevice(&proxyDevice, reportMapSize);
-    Serial.printf("addDevice returned: %d\n", deviceAdded);
+    for (size_t i = 0; i < peer.bindings.count(); i++)
+    {
+      const ReportBinding &binding = peer.bindings.at(i);
+      if (binding.type != type)
+        continue;
+
+      // The synthesized descriptor has one output report: the keyboard LEDs
+      bool match = usbSynthesized ? usbReportId == BOOT_REPORT_KEYBOARD && binding.layout &&
+                                        binding.layout->kind == HID_KIND_KEYBOARD
+                                  : peer.usbReportIds[binding.reportId] == usbReportId;
+      if (!match)
+        continue;
+
+      size_t n = binding.length && binding.length < length ? binding.length : length;
+      int rc = type == HID_REPORT_OUTPUT
+                   ? ble_gattc_write_no_rsp_flat(peer.connHandle, binding.handle, data, n)
+                   : ble_gattc_write_flat(peer.connHandle, binding.handle, data, n, nullptr, nullptr);
+      LOGD("%s report %d -> %s handle 0x%04X: rc=%d\n", HIDReportMap::typeName(type), usbReportId,
+           peer.address.toString().c_str(), binding.handle, rc);
+    }
+  }
+}
 
-    HID.begin();
-    Serial.println("HID.begin() called");
+void releaseClient(Peer &peer)
+{
+  deviceInfo.stop(&peer - peers);
+  if (peer.client)
+    NimBLEDevice::deleteClient(peer.client);
+  peer.client = nullptr;
+  peer.securing = false;
+  peer.repairing = false;
+  peer.boot.releaseHeld();
+  setPeerState(peer, PEER_IDLE);
+}
 
-    USB.begin();
-    Serial.println("USB.begin() called");
+void handleEvent(const ProxyEvent &event)
+{
+  Peer *peer = event.peer < PROXY_MAX_PEERS ? &peers[event.peer] : nullptr;
+  telemetry.countEvent(event.type);
+  // Background scans alone do not keep the proxy awake
+  if (event.type != EVENT_SCAN_END)
+    powerManager.onActivity();
+
+  switch (event.type)
+  {
+  case EVENT_SCAN_END:
+    connectNextPending();
+    rescanIfIdle();
+    break;
+
+  case EVENT_CONNECTED:
+    if (peer->state != PEER_CONNECTING)
+      break;
 
-    // Give USB time to enumerate
-    delay(1000);
+    LOGI("Connected, securing connection (%s)...\n",
+         pairingStats.path(event.peer) == SECURITY_RESUMED ? "stored key" : "pairing");
+    setPeerState(*peer, PEER_SECURING);
+
+    // Normally started in onConnect(); the result arrives as EVENT_SECURED
+    if (!peer->securing && !peer->client->secureConnection(true))
+    {
+      LOGW("Security setup failed, continuing anyway...\n");
+      setupPeer(*peer);
+    }
+    connectNextPending();
+    break;
 
-    bool hidReady = HID.ready();
-    Serial.printf("HID.ready() = %d\n", hidReady);
+  case EVENT_CONNECT_FAILED:
+    LOGE("Connection failed! (reason %d)\n", event.status);
+    statusDisplay.setPhase(UI_CONNECT_FAILED);
 
+    releaseClient(*peer);
+    connectNextPending();
+    rescanIfIdle();
+    break;
+
+  case EVENT_SECURED:
+    if (peer->state != PEER_SECURING)
+      break;
+
+    // The peer dropped its bond (reset, paired elsewhere): forget ours and
+    // pair from scratch, once
+    if (event.status == SECURE_KEY_MISSING && !peer->repairing)
+    {
+      NimBLEAddress identity(peer->client->getConnInfo().getIdAddress());
+      LOGW("%s rejected the stored key, pairing again\n", identity.toString().c_str());
+      NimBLEDevice::deleteBond(identity);
+      peerCache.remove(identity);
+      peer->repairing = true;
+      pairingStats.fallback(event.peer);
+      setPeerState(*peer, PEER_SECURING);
+      if (peer->client->secureConnection(true))
+        break;
+    }
+
+    if (event.status != SECURE_OK)
+      LOGW("Security setup failed, continuing anyway...\n");
+    setupPeer(*peer);
+    break;
+
+  case EVENT_DISCONNECTED:
+    // The slot keeps its address and report map for the next connection
+    releaseClient(*peer);
+    // A peer that just dropped gets the back to back reconnect rounds again
+    reconnectRounds = 0;
+    rescanIfIdle();
+    break;
+
+  case EVENT_CACHE_INVALID:
+    // A peer rejected a cached handle: forget the cache and reconnect
+    if (peer->connected)
+    {
+      LOGW("Cached GATT handles for %s are stale, rediscovering\n",
+           peer->identity.toString().c_str());
+      peerCache.remove(peer->identity);
+      peer->client->disconnect();
+    }
+    break;
+
+  case EVENT_USB_MOUNTED:
     usbReady = true;
+    usbForwarder.resetHostState();
+    powerManager.setUsbActive(true);
+    LOGI("USB HID initialized!\n");
+    statusDisplay.setUsbReady(true);
+    healthMonitor.setUsbMounted(true);
+    break;
+
+  case EVENT_USB_UNMOUNTED:
+    usbReady = false;
+    powerManager.setUsbActive(false);
+    LOGI("USB HID unmounted\n");
+    statusDisplay.setUsbReady(false);
+    healthMonitor.setUsbMounted(false);
+    break;
+
+  case EVENT_OUTPUT_REPORT:
+    outputRelay.flush(writeOutputReport);
+    break;
+
+  case EVENT_PEER_ACTIVE:
+    if (peer->state == PEER_READY)
+      connTuner.activate(event.peer, peer->client);
+    break;
+
+  case EVENT_REPORT_MAP_READ:
+    completeReportMapRead(*peer);
+    break;
+  }
+}
 
-    Serial.println("USB HID initialized!");
+// Steps that are not bounded by a NimBLE timeout of their own
+void checkTimeouts()
+{
+  uint32_t now = millis();
+  for (Peer &peer : peers)
+  {
+    if (peer.state == PEER_SECURING && now - peer.stateSince > SECURE_TIMEOUT)
+    {
+      LOGW("Security setup timed out, continuing anyway...\n");
+      pairingStats.timeout(&peer - peers);
+      setupPeer(peer);
+    }
 
-    tft.setTextColor(TFT_GREEN);
-    tft.println("USB HID READY");
-    tft.setTextColor(TFT_WHITE);
+    if (peer.state == PEER_DISCOVERING)
+      checkReportMapRead(peer);
+
+    if (peer.state == PEER_READY)
+      connTuner.update(&peer - peers, peer.client);
   }
-  else
+
+  // Changes held back by the flush window
+  outputRelay.flush(writeOutputReport);
+}
+
+// Samples the values the display shows but nothing reports as an event
+void updateStatus()
+{
+  static uint32_t lastUpdate = 0;
+  if (millis() - lastUpdate < STATUS_UPDATE_INTERVAL)
+    return;
+  lastUpdate = millis();
+
+  for (Peer &peer : peers)
   {
-    Serial.println("ERROR: No report map data available!");
+    uint8_t index = &peer - peers;
+    if (peer.state != PEER_READY)
+    {
+      statusDisplay.setPeerRate(index, 0);
+      continue;
+    }
+
+    uint32_t intervalUs = connTuner.reportIntervalUs(index);
+    bool idle = connTuner.isIdle(index) || intervalUs == 0;
+    statusDisplay.setPeerRate(index, idle ? 0 : 1000000 / intervalUs);
+
+    // Doubles as a link probe: a hung connection stops answering
+    int rssi = peer.client->getRssi();
+    healthMonitor.onLinkProbe(index, rssi != 0);
+    statusDisplay.setPeerRssi(index, rssi);
   }
 
-  // Subscribe to HID reports
-  subscribeToReports(pClient);
+#if PROXY_LATENCY_STATS
+  statusDisplay.setLatency(latencyStats.totalPercentileUs(99));
+#endif
+}
+
+void usbEventCallback(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+  if (base != ARDUINO_USB_EVENTS)
+    return;
+
+  if (id == ARDUINO_USB_STARTED_EVENT || id == ARDUINO_USB_RESUME_EVENT)
+    postEvent(EVENT_USB_MOUNTED);
+  else if (id == ARDUINO_USB_STOPPED_EVENT || id == ARDUINO_USB_SUSPEND_EVENT)
+    postEvent(EVENT_USB_UNMOUNTED);
+}
+
+// Passive scan that the controller filters down to whitelisted (bonded)
+// peers, so a waking peer is found on its first advertisement
+void startReconnectScan()
+{
+  for (Peer &peer : peers)
+  {
+    delete peer.advDevice;
+    peer.advDevice = nullptr;
+  }
+
+  NimBLEScan *pScan = NimBLEDevice::getScan();
+  pScan->setScanCallbacks(&scanCallbacks);
+  pScan->setFilterPolicy(BLE_HCI_SCAN_FILT_USE_WL);
+  pScan->setActiveScan(false);
+  pScan->setInterval(RECONNECT_SCAN_INTERVAL);
+  bool linked = anyPeerActive();
+  pScan->setWindow(linked ? RECONNECT_SCAN_WINDOW_LINKED : RECONNECT_SCAN_INTERVAL);
+  pScan->setDuplicateFilter(false);
+  pScan->setMaxResults(0xFF);
+
+  if (linked)
+  {
+    if (reconnectRounds < 0xFF)
+      reconnectRounds++;
+    lastReconnectMs = millis();
+  }
 
-  delete advDevice;
-  advDevice = nullptr;
+  reconnectScan = true;
+  backgroundScan = false;
+  pScan->start(RECONNECT_SCAN_DURATION);
+}
+
+// Listens for other HID devices while the peers are linked. Passive (no
+// scan requests) with a duty cycle well under 1%, so the links keep the radio.
+void startBackgroundScan()
+{
+  NimBLEScan *pScan = NimBLEDevice::getScan();
+  pScan->setScanCallbacks(&scanCallbacks);
+  pScan->setFilterPolicy(BLE_HCI_SCAN_FILT_NO_WL);
+  pScan->setActiveScan(false);
+  pScan->setInterval(BACKGROUND_SCAN_INTERVAL);
+  pScan->setWindow(BACKGROUND_SCAN_WINDOW);
+  pScan->setDuplicateFilter(false);
+  pScan->setMaxResults(0); // callbacks only, the standby list keeps what matters
+
+  reconnectScan = false;
+  backgroundScan = true;
+  pScan->start(BACKGROUND_SCAN_DURATION);
 }
 
 void startScan()
 {
   startAdvertising();
 
-  Serial.println("\n=== Starting BLE Scan ===");
+  // Bonded peers are reconnected through the whitelist first
+  if (!fullScanDue && syncWhiteList() > 0)
+  {
+    LOGI("\n=== Waiting for bonded peers ===\n");
+    statusDisplay.setPhase(UI_RECONNECTING);
 
-  clearDisplay();
-  tft.setTextColor(TFT_MAGENTA);
-  tft.println("SCANNING...");
-  tft.setTextColor(TFT_WHITE);
+    startReconnectScan();
+    return;
+  }
+  fullScanDue = false;
 
-  if (advDevice)
+  // Failover: devices the background scan heard connect without a new scan
+  backgroundScan = false;
+  if (assignStandby() > 0)
   {
-    delete advDevice;
-    advDevice = nullptr;
+    LOGI("\n=== Connecting to standby devices ===\n");
+    statusDisplay.setPhase(UI_CONNECTING);
+    connectNextPending();
+    return;
   }
-  doConnect = false;
+
+  LOGI("\n=== Starting BLE Scan ===\n");
+  statusDisplay.setPhase(UI_SCANNING);
+  hidDevicesFound = 0;
+  statusDisplay.setDevicesFound(0);
+
+  for (Peer &peer : peers)
+  {
+    delete peer.advDevice;
+    peer.advDevice = nullptr;
+  }
+  candidates.clear();
 
   NimBLEScan *pScan = NimBLEDevice::getScan();
   pScan->setScanCallbacks(&scanCallbacks);
+  pScan->setFilterPolicy(BLE_HCI_SCAN_FILT_NO_WL);
   pScan->setActiveScan(true);
-  pScan->setInterval(80);
-  pScan->setWindow(48);
+  pScan->setInterval(SCAN_INTERVAL);
+  pScan->setWindow(SCAN_WINDOW);
   pScan->setDuplicateFilter(true);
+  pScan->setMaxResults(0xFF);
+
+  reconnectScan = false;
   pScan->start(SCAN_DURATION);
 }
 
@@ -572,30 +1661,168 @@ void startAdvertising()
   pAdvertising->setDiscoverableMode(BLE_GAP_DISC_MODE_GEN);
   pAdvertising->setName(DEVICE_NAME);
   pAdvertising->start();
-  Serial.println("Started advertising");
+  LOGI("Started advertising\n");
+}
+
+// Commands from the binary protocol on the CDC port, see Telemetry.h
+uint8_t handleTelemetryCommand(uint8_t type, const uint8_t *payload, size_t length)
+{
+  switch (type)
+  {
+  case FRAME_RESCAN:
+    LOGI("Full scan requested\n");
+    fullScanDue = true;
+    // A running scan is restarted as a full one from EVENT_SCAN_END
+    if (NimBLEDevice::getScan()->isScanning())
+    {
+      NimBLEDevice::getScan()->stop();
+      postEvent(EVENT_SCAN_END);
+    }
+    else
+      startScan();
+    return TELEMETRY_OK;
+
+  case FRAME_FORGET_BOND:
+    if (length != 1)
+      return TELEMETRY_BAD_LENGTH;
+    if (payload[0] == 0xFF)
+    {
+      LOGI("Forgetting all bonds\n");
+      NimBLEDevice::deleteAllBonds();
+      peerCache.clear();
+      for (Peer &peer : peers)
+      {
+        if (peer.connected)
+          peer.client->disconnect();
+      }
+      return TELEMETRY_OK;
+    }
+    if (payload[0] >= PROXY_MAX_PEERS || peers[payload[0]].identity.isNull())
+      return TELEMETRY_BAD_ARGUMENT;
+    {
+      Peer &peer = peers[payload[0]];
+      LOGI("Forgetting bond with %s\n", peer.identity.toString().c_str());
+      NimBLEDevice::deleteBond(peer.identity);
+      peerCache.remove(peer.identity);
+      if (peer.connected)
+        peer.client->disconnect();
+    }
+    return TELEMETRY_OK;
+
+  case FRAME_SET_CONN_PARAMS:
+  {
+    if (length != 9)
+      return TELEMETRY_BAD_LENGTH;
+    if (payload[0] >= PROXY_MAX_PEERS)
+      return TELEMETRY_BAD_ARGUMENT;
+    Peer &peer = peers[payload[0]];
+    if (peer.state != PEER_READY)
+      return TELEMETRY_NOT_CONNECTED;
+
+    uint16_t params[4];
+    for (uint8_t i = 0; i < 4; i++)
+      params[i] = payload[1 + 2 * i] | (payload[2 + 2 * i] << 8);
+    // Held until the tuner next switches between active and idle
+    return peer.client->updateConnParams(params[0], params[1], params[2], params[3])
+               ? TELEMETRY_OK
+               : TELEMETRY_BAD_ARGUMENT;
+  }
+
+  case FRAME_SET_PROFILE:
+    if (length != 1)
+      return TELEMETRY_BAD_LENGTH;
+    if (payload[0] >= CONN_PROFILE_COUNT)
+      return TELEMETRY_BAD_ARGUMENT;
+    connTuner.setProfile(payload[0]);
+    return TELEMETRY_OK;
+  }
+  return TELEMETRY_UNKNOWN_COMMAND;
+}
+
+// Performs one step of the health monitor's recovery ladder
+bool runRecovery(RecoveryStep step, uint8_t index)
+{
+  Peer *peer = index < PROXY_MAX_PEERS ? &peers[index] : nullptr;
+
+  switch (step)
+  {
+  case RECOVER_RESUBSCRIBE:
+    return peer && peer->state == PEER_READY && resubscribe(*peer);
+
+  case RECOVER_RECONNECT:
+    if (!peer || !peer->connected)
+      return false;
+    // The next connection rediscovers instead of trusting the cached handles
+    peerCache.remove(peer->identity);
+    return peer->client->disconnect();
+
+  case RECOVER_USB_REINIT:
+    proxyDevice.reattach();
+    // The host enumerates afresh: old failures and sent state no longer apply
+    usbForwarder.resetHostState();
+    return true;
+
+  default:
+    LOGE("Restarting to recover\n");
+    Serial.flush();
+    esp_restart();
+    return true;
+  }
+}
+
+// A peer changed the descriptor length, which USBHID fixes when it starts:
+// restart once setup is done, the new descriptor is served from NVS
+void restartForDescriptor()
+{
+  if (!proxyDevice.restartPending())
+    return;
+  for (Peer &peer : peers)
+  {
+    if (peer.state == PEER_DISCOVERING)
+      return;
+  }
+
+  LOGW("Restarting to register the new USB report descriptor\n");
+  Serial.flush();
+  esp_restart();
 }
 
 void setup()
 {
   Serial.begin(115200);
-  Serial.println("--- BOOT START ---");
+  LOGI("--- BOOT START ---\n");
+
+#if PROXY_LOADGEN
+  // Stress rig: a synthetic HID peripheral instead of the proxy
+  loadGen.begin();
+  return;
+#endif
 
-  tft.begin();
-  tft.setRotation(1);
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextSize(1);
-  tft.setTextColor(TFT_WHITE);
-  tft.setCursor(0, 0);
-  tft.setTextDatum(MC_DATUM);
-  tft.setSwapBytes(true);
+  // Below the forwarding task, see the threading plan in ProxyConfig.h
+  vTaskPrioritySet(nullptr, PROXY_LOOP_TASK_PRIORITY);
+  LOGI("loop() on core %d, USB task on core %d, NimBLE host on core %d\n", xPortGetCoreID(),
+       PROXY_USB_TASK_CORE, CONFIG_BT_NIMBLE_PINNED_TO_CORE);
 
-  Serial.println("TFT Initialized");
+  // The display task owns the TFT from here on
+  statusDisplay.begin();
+  LOGI("TFT Initialized\n");
+  powerManager.begin();
 
-  tft.drawCentreString("BLE HID Proxy", tft.width() / 2, tft.height() / 2, 2);
-  Serial.println("BLE HID Proxy");
+  proxyEventsBegin();
+  transformConfig.loadDefaults();
+  telemetry.setCommandHandler(handleTelemetryCommand);
+  healthMonitor.begin(runRecovery);
 
-  // Initialize NimBLE
+  LOGI("BLE HID Proxy\n");
+
+  // Initialize NimBLE; the bonds it loads decide the first USB descriptor
   NimBLEDevice::init(DEVICE_NAME);
+  size_t restored = restorePeers();
+
+  // Start the USB forwarding task; it idles until reports are queued
+  usbForwarder.begin(&HID);
+  USB.onEvent(usbEventCallback);
+  startUsb(restored > 0);
 
   // Set security parameters
   NimBLEDevice::setSecurityAuth(true, true, true); // bonding, MITM, SC
@@ -606,11 +1833,14 @@ void setup()
   // Set MTU
   NimBLEDevice::setMTU(517);
 
+  // Receive notifications at the GAP level, see gapEventHandler
+  NimBLEDevice::setCustomGapHandler(gapEventHandler);
+
   // Create a server to allow for reverse connections
   NimBLEServer *pServer = NimBLEDevice::createServer();
   pServer->start();
 
-  Serial.printf("Device Address: %s\n", NimBLEDevice::getAddress().toString().c_str());
+  LOGI("Device Address: %s\n", NimBLEDevice::getAddress().toString().c_str());
 
   // Start scanning
   startScan();
@@ -618,18 +1848,30 @@ void setup()
 
 void loop()
 {
-  if (doConnect)
-  {
-    doConnect = false;
-    connectToDevice();
-  }
-
-  // If disconnected and not scanning, restart scan
-  if (!deviceConnected && !NimBLEDevice::getScan()->isScanning() && pClient == nullptr)
-  {
-    delay(2000);
-    startScan();
-  }
-
-  delay(10);
+#if PROXY_LOADGEN
+  loadGen.poll();
+  delay(EVENT_POLL_INTERVAL);
+  return;
+#endif
+
+  // Each step of the connection sequence runs as soon as its event arrives
+  // Housekeeping slows down while idle so the CPU can sleep in between
+  ProxyEvent event;
+  uint32_t timeout = powerManager.state() == POWER_IDLE ? POWER_IDLE_POLL_INTERVAL : EVENT_POLL_INTERVAL;
+  // LED changes batched by the output relay go out when their window ends
+  uint32_t flushDelay = outputRelay.flushDelayMs();
+  if (flushDelay < timeout)
+    timeout = flushDelay;
+  if (waitEvent(event, timeout))
+    handleEvent(event);
+
+  checkTimeouts();
+  restartForDescriptor();
+  deviceInfo.poll();
+  updateStatus();
+  powerManager.poll();
+  healthMonitor.poll();
+  consolePoll();
+  telemetry.poll();
+  traceFlush();
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+// Unit tests of ReportCoalescer, native environment only:
+//
+//   pio test -e native -f test_coalescer
+//
+// Uses the synthesized boot descriptor: keyboard (ID 1) and consumer (ID 3)
+// get hold rules, the mouse (ID 2) a merge rule.
+#include <unity.h>
+#include <string.h>
+#include "BootReports.h"
+#include "ReportCoalescer.h"
+
+static HIDReportMap map;
+static ReportCoalescer coalescer;
+
+static ReportSlot mouse(uint8_t buttons, int8_t x, int8_t y)
+{
+  ReportSlot slot = {};
+  slot.reportId = BOOT_REPORT_MOUSE;
+  slot.length = BOOT_MOUSE_LENGTH;
+  slot.data[0] = buttons;
+  slot.data[1] = x;
+  slot.data[2] = y;
+  return slot;
+}
+
+static ReportSlot keyboard(uint8_t modifiers, uint8_t key)
+{
+  ReportSlot slot = {};
+  slot.reportId = BOOT_REPORT_KEYBOARD;
+  slot.length = BOOT_KEYBOARD_LENGTH;
+  slot.data[0] = modifiers;
+  slot.data[2] = key;
+  return slot;
+}
+
+static ReportSlot consumer(uint16_t usage)
+{
+  ReportSlot slot = {};
+  slot.reportId = BOOT_REPORT_CONSUMER;
+  slot.length = BOOT_CONSUMER_LENGTH;
+  slot.data[0] = usage & 0xFF;
+  slot.data[1] = usage >> 8;
+  return slot;
+}
+
+void setUp()
+{
+  coalescer.clear();
+  coalescer.configure(map);
+}
+
+void tearDown()
+{
+}
+
+void test_motion_is_summed()
+{
+  TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.add(mouse(0, 10, -3)));
+  TEST_ASSERT_EQUAL(COALESCE_MERGED, coalescer.add(mouse(0, 5, -4)));
+
+  const ReportSlot *pending = coalescer.findPending(BOOT_REPORT_MOUSE);
+  TEST_ASSERT_TRUE(pending != nullptr);
+  TEST_ASSERT_EQUAL(15, (int8_t)pending->data[1]);
+  TEST_ASSERT_EQUAL(-7, (int8_t)pending->data[2]);
+  TEST_ASSERT_EQUAL(1, coalescer.mergedCount());
+}
+
+void test_motion_overflow_conflicts()
+{
+  coalescer.add(mouse(0, 100, 0));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(mouse(0, 100, 0)));
+  TEST_ASSERT_EQUAL(100, (int8_t)coalescer.findPending(BOOT_REPORT_MOUSE)->data[1]);
+}
+
+void test_button_release_conflicts()
+{
+  coalescer.add(mouse(1, 0, 0));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(mouse(0, 0, 0)));
+}
+
+void test_button_repress_conflicts()
+{
+  // Host saw the button down; the release is pending, the re-press must not fold into it
+  coalescer.add(mouse(0, 0, 0));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(mouse(1, 0, 0)));
+  TEST_ASSERT_EQUAL(0, coalescer.findPending(BOOT_REPORT_MOUSE)->data[0]);
+}
+
+void test_key_tap_conflicts()
+{
+  coalescer.add(keyboard(0, 0x04));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(keyboard(0, 0)));
+}
+
+void test_key_double_tap_conflicts()
+{
+  coalescer.add(keyboard(0, 0));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(keyboard(0, 0x04)));
+}
+
+void test_modifier_change_conflicts()
+{
+  coalescer.add(keyboard(0x02, 0x04));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(keyboard(0, 0x04)));
+}
+
+void test_unchanged_keys_fold()
+{
+  coalescer.add(keyboard(0x02, 0x04));
+  TEST_ASSERT_EQUAL(COALESCE_MERGED, coalescer.add(keyboard(0x02, 0x04)));
+  TEST_ASSERT_EQUAL(1, coalescer.pendingCount());
+}
+
+void test_consumer_change_conflicts()
+{
+  coalescer.add(consumer(0xE9));
+  TEST_ASSERT_EQUAL(COALESCE_CONFLICT, coalescer.add(consumer(0)));
+}
+
+void test_pending_order()
+{
+  coalescer.add(keyboard(0, 0x04));
+  coalescer.add(mouse(0, 1, 1));
+  coalescer.add(consumer(0xE9));
+  TEST_ASSERT_EQUAL(3, coalescer.pendingCount());
+
+  coalescer.removePending(BOOT_REPORT_KEYBOARD);
+  TEST_ASSERT_EQUAL(2, coalescer.pendingCount());
+  TEST_ASSERT_EQUAL(BOOT_REPORT_MOUSE, coalescer.pending(0).reportId);
+  TEST_ASSERT_EQUAL(BOOT_REPORT_CONSUMER, coalescer.pending(1).reportId);
+  TEST_ASSERT_TRUE(coalescer.findPending(BOOT_REPORT_KEYBOARD) == nullptr);
+
+  // An ID that is no longer pending queues afresh
+  TEST_ASSERT_EQUAL(COALESCE_QUEUED, coalescer.add(keyboard(0, 0)));
+}
+
+int main()
+{
+  map.parse(bootReportDescriptor, bootReportDescriptorSize);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_motion_is_summed);
+  RUN_TEST(test_motion_overflow_conflicts);
+  RUN_TEST(test_button_release_conflicts);
+  RUN_TEST(test_button_repress_conflicts);
+  RUN_TEST(test_key_tap_conflicts);
+  RUN_TEST(test_key_double_tap_conflicts);
+  RUN_TEST(test_modifier_change_conflicts);
+  RUN_TEST(test_unchanged_keys_fold);
+  RUN_TEST(test_consumer_change_conflicts);
+  RUN_TEST(test_pending_order);
+  return UNITY_END();
+}
@@ -0,0 +1,230 @@
+#include "TraceReplay.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BootReports.h"
+#include "ForwardPipeline.h"
+#include "PipelineStages.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define REPLAY_CYCLES() __rdtsc()
+#else
+#define REPLAY_CYCLES() 0ull
+#endif
+
+#define TRACE_DATA_BYTES 8
+#define MAX_PEER_MAP 512
+
+void TraceReplay::clear()
+{
+  _descriptor.clear();
+  _count = 0;
+}
+
+void TraceReplay::addMap(const uint8_t *map, size_t len)
+{
+  uint8_t idMap[256];
+  if (len && !_descriptor.append(map, len, idMap))
+    fprintf(stderr, "replay: report map of %zu bytes does not fit the descriptor\n", len);
+}
+
+ReplayReport *TraceReplay::addReport(uint32_t timeUs, uint8_t reportId, uint8_t length)
+{
+  if (_count == REPLAY_MAX_REPORTS || length > REPORT_SLOT_SIZE)
+    return nullptr;
+
+  ReplayReport &report = _reports[_count++];
+  memset(&report, 0, sizeof(report));
+  report.timeUs = timeUs;
+  report.reportId = reportId;
+  report.length = length;
+  return &report;
+}
+
+bool TraceReplay::loadLog(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  static uint8_t map[MAX_PEER_MAP];
+  size_t mapSize = 0;
+  bool inMap = false;
+  char line[512];
+
+  while (fgets(line, sizeof(line), file))
+  {
+    unsigned timeUs, id, length;
+    int offset;
+    if (strstr(line, "Report Map (hex):"))
+    {
+      addMap(map, mapSize);
+      mapSize = 0;
+      inMap = true;
+    }
+    else if (sscanf(line, " [%u] BLE RX id=%u len=%u:%n", &timeUs, &id, &length, &offset) == 3)
+    {
+      ReplayReport *report = addReport(timeUs, id, length);
+      const char *p = line + offset;
+      unsigned byte;
+      int n;
+      for (uint8_t i = 0; report && i < length && i < TRACE_DATA_BYTES && sscanf(p, " %2x%n", &byte, &n) == 1; i++, p += n)
+        report->data[i] = byte;
+    }
+    else if (inMap)
+    {
+      // Hex rows until the first line that is not one
+      const char *p = line;
+      unsigned byte;
+      int n;
+      bool any = false;
+      while (sscanf(p, " %2x%n", &byte, &n) == 1 && mapSize < MAX_PEER_MAP)
+      {
+        map[mapSize++] = byte;
+        p += n;
+        any = true;
+      }
+      if (!any)
+        inMap = false;
+    }
+  }
+  addMap(map, mapSize);
+
+  fclose(file);
+  return _descriptor.size() > 0 && _count > 0;
+}
+
+void TraceReplay::generate(uint32_t count)
+{
+  clear();
+  uint8_t idMap[256];
+  _descriptor.append(bootReportDescriptor, bootReportDescriptorSize, idMap);
+
+  uint32_t seed = 12345;
+  uint32_t timeUs = 0;
+  uint8_t buttons = 0;
+  while (_count < count)
+  {
+    seed = seed * 1103515245 + 12345;
+
+    // Three mouse reports per connection event, back to back on air
+    for (int i = 0; i < 3; i++)
+    {
+      ReplayReport *mouse = addReport(timeUs + i * 300, idMap[BOOT_REPORT_MOUSE], BOOT_MOUSE_LENGTH);
+      if (!mouse)
+        return;
+      if ((seed >> 20) % 50 == 0)
+        buttons ^= 1;
+      mouse->data[0] = buttons;
+      mouse->data[1] = (seed >> 8) % 15 - 7;
+      mouse->data[2] = (seed >> 12) % 15 - 7;
+      mouse->data[3] = (seed >> 16) % 40 == 0 ? 1 : 0;
+    }
+
+    // A key press and release every few events, a media key now and then
+    bool typing = (seed >> 24) % 8 == 0;
+    if (typing)
+    {
+      ReplayReport *press = addReport(timeUs + 4000, idMap[BOOT_REPORT_KEYBOARD], BOOT_KEYBOARD_LENGTH);
+      if (press)
+        press->data[2] = 0x04 + (seed >> 4) % 26;
+    }
+    if ((seed >> 26) % 32 == 0)
+    {
+      ReplayReport *media = addReport(timeUs + 5000, idMap[BOOT_REPORT_CONSUMER], BOOT_CONSUMER_LENGTH);
+      if (media)
+        media->data[0] = 0xE9;
+    }
+    if (typing)
+      addReport(timeUs + 6000, idMap[BOOT_REPORT_KEYBOARD], BOOT_KEYBOARD_LENGTH);
+
+    timeUs += 7500;
+  }
+}
+
+struct ReplaySink
+{
+  uint32_t sent = 0;
+  uint32_t checksum = 0;
+
+  void operator()(const ReportSlot &report)
+  {
+    sent++;
+    for (uint8_t i = 0; i < report.length; i++)
+      checksum = (checksum ^ report.data[i]) * 16777619u;
+  }
+};
+
+ReplayResult TraceReplay::run(uint32_t usbIntervalUs)
+{
+  // Connect-time work, not timed
+  static HIDReportMap map;
+  static ForwardPipeline<1, 32> pipeline;
+  static TransformStage transform;
+  static TransformConfig config;
+  map.parse(_descriptor.data(), _descriptor.size());
+  pipeline.configure(map);
+  config.loadDefaults();
+  transform.compile(map, config);
+
+  ReplayResult result = {};
+  ReplaySink sink;
+  uint32_t busyUntilUs = 0;
+  uint32_t mergedBefore = pipeline.mergedCount();
+  uint32_t suppressedBefore = pipeline.dedup().suppressedCount();
+  size_t allocationsBefore = replayAllocations;
+  uint64_t cyclesBefore = REPLAY_CYCLES();
+  auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < _count; i++)
+  {
+    const ReplayReport &report = _reports[i];
+    result.reports++;
+
+    // The endpoint went idle before this report: what was pending went out then
+    if (pipeline.pendingCount() && report.timeUs >= busyUntilUs)
+    {
+      pipeline.sendPending(sink);
+      busyUntilUs += usbIntervalUs;
+    }
+
+    const HIDReportLayout *layout = map.find(HID_REPORT_INPUT, report.reportId);
+    if (!layout)
+    {
+      result.unknown++;
+      continue;
+    }
+    ReportSlot *slot = transform.drops(layout->id) ? nullptr : pipeline.beginReport(0);
+    if (!slot)
+    {
+      result.dropped++;
+      continue;
+    }
+    memcpy(slot->data, report.data, report.length);
+    transform.apply(layout->id, slot->data, report.length);
+    slot->rxUs = report.timeUs;
+    slot->reportId = report.reportId;
+    slot->length = report.length;
+    pipeline.commitReport(0);
+
+    pipeline.collect(sink);
+    if (report.timeUs >= busyUntilUs)
+    {
+      pipeline.sendPending(sink);
+      busyUntilUs = report.timeUs + usbIntervalUs;
+    }
+  }
+  pipeline.sendPending(sink);
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  result.cycles = REPLAY_CYCLES() - cyclesBefore;
+  result.elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  result.allocations = replayAllocations - allocationsBefore;
+  result.sent = sink.sent;
+  result.checksum = sink.checksum;
+  result.merged = pipeline.mergedCount() - mergedBefore;
+  result.suppressed = pipeline.dedup().suppressedCount() - suppressedBefore;
+  return result;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CompositeDescriptor.h"
+#include "ReportSlot.h"
+
+#define REPLAY_MAX_REPORTS 20000
+
+// Full-speed HID interrupt endpoint, one IN transfer per 1 ms frame
+#define REPLAY_USB_INTERVAL_US 1000
+
+struct ReplayReport
+{
+  uint32_t timeUs;
+  uint8_t reportId; // USB report ID, as in the trace
+  uint8_t length;
+  uint8_t data[REPORT_SLOT_SIZE];
+};
+
+struct ReplayResult
+{
+  uint32_t reports;
+  uint32_t unknown; // no input report with that ID in the descriptor
+  uint32_t dropped; // transform drop or ring full
+  uint32_t sent;
+  uint32_t merged;
+  uint32_t suppressed; // repeats of the last report sent with the same ID
+  uint32_t checksum; // over everything sent, keeps the work observable
+  uint64_t elapsedNs;
+  uint64_t cycles; // 0 where no cycle counter is available
+  size_t allocations;
+};
+
+// Replays a recorded report trace through the forwarding pipeline: report
+// classification, transforms, ring hand-off, coalescing and duplicate
+// suppression, with the USB endpoint modelled as busy for
+// REPLAY_USB_INTERVAL_US after each send.
+class TraceReplay
+{
+public:
+  void clear();
+
+  // Reads a serial log. "Report Map (hex):" blocks (PROXY_LOG_LEVEL=4) give
+  // the peer report maps, merged as updateUsbDescriptor() does so report
+  // IDs match; "BLE RX" lines (PROXY_TRACE=1) give the reports. Trace
+  // records only keep TRACE_DATA_BYTES of payload, the rest is zero.
+  bool loadLog(const char *path);
+
+  // Deterministic keyboard + mouse + consumer load on the boot descriptor:
+  // bursts of mouse reports per 7.5 ms connection event, typing, media keys
+  void generate(uint32_t count);
+
+  ReplayResult run(uint32_t usbIntervalUs = REPLAY_USB_INTERVAL_US);
+
+  size_t reportCount() const { return _count; }
+  size_t descriptorSize() const { return _descriptor.size(); }
+
+private:
+  void addMap(const uint8_t *map, size_t len);
+  ReplayReport *addReport(uint32_t timeUs, uint8_t reportId, uint8_t length);
+
+  CompositeDescriptor _descriptor;
+  ReplayReport _reports[REPLAY_MAX_REPORTS];
+  size_t _count = 0;
+};
+
+// Incremented by the test's global operator new
+extern volatile size_t replayAllocations;
@@ -0,0 +1,123 @@
+// Replay benchmark of the forwarding pipeline, native environment only:
+//
+//   pio test -e native -v
+//
+// Replays a generated keyboard + mouse load and, if PROXY_REPLAY_TRACE names
+// a serial log captured with PROXY_LOG_LEVEL=4 and PROXY_TRACE=1, that
+// trace. Prints throughput, time and cycles per report; fails if the hot
+// path allocates or loses reports.
+#include <unity.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include "TraceReplay.h"
+#include "PipelineStages.h"
+
+#define GENERATED_REPORTS 20000
+#define REPLAY_ROUNDS 20
+
+volatile size_t replayAllocations = 0;
+
+void *operator new(size_t size)
+{
+  replayAllocations++;
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+  free(p);
+}
+
+static TraceReplay replay;
+
+static void report(const char *name, const ReplayResult &result)
+{
+  double perReportNs = (double)result.elapsedNs / result.reports;
+  printf("%s: %u reports, %u sent, %u merged, %u deduplicated, %u dropped, %u unknown\n", name,
+         result.reports, result.sent, result.merged, result.suppressed, result.dropped, result.unknown);
+  printf("%s: %.0f reports/s, %.1f ns/report, %.0f cycles/report, %zu allocations\n", name,
+         1e9 / perReportNs, perReportNs, (double)result.cycles / result.reports, result.allocations);
+}
+
+// Best of several rounds, so one scheduler hiccup does not fail CI
+static ReplayResult runBest()
+{
+  ReplayResult best = replay.run();
+  for (int i = 1; i < REPLAY_ROUNDS; i++)
+  {
+    ReplayResult result = replay.run();
+    TEST_ASSERT_EQUAL_UINT32(best.checksum, result.checksum);
+    if (result.elapsedNs < best.elapsedNs)
+      best = result;
+  }
+  return best;
+}
+
+static void checkAccounting(const ReplayResult &result)
+{
+  TEST_ASSERT_EQUAL(0, result.allocations);
+  TEST_ASSERT_EQUAL_UINT32(result.reports,
+                           result.sent + result.merged + result.suppressed + result.dropped + result.unknown);
+}
+
+void test_generated_load()
+{
+  replay.generate(GENERATED_REPORTS);
+  TEST_ASSERT_EQUAL(GENERATED_REPORTS, replay.reportCount());
+
+  ReplayResult result = runBest();
+  report("generated", result);
+  checkAccounting(result);
+  TEST_ASSERT_EQUAL_UINT32(0, result.unknown);
+  TEST_ASSERT_EQUAL_UINT32(0, result.dropped);
+#if PROXY_STAGE_COALESCE
+  TEST_ASSERT_TRUE(result.merged > 0);
+#endif
+}
+
+void test_recorded_trace()
+{
+  const char *path = getenv("PROXY_REPLAY_TRACE");
+  if (!path)
+    TEST_IGNORE_MESSAGE("set PROXY_REPLAY_TRACE to replay a captured log");
+
+  replay.clear();
+  TEST_ASSERT_TRUE_MESSAGE(replay.loadLog(path), "no report map or reports in trace");
+  printf("trace: %zu reports, %zu byte descriptor\n", replay.reportCount(), replay.descriptorSize());
+
+  ReplayResult result = runBest();
+  report("trace", result);
+  checkAccounting(result);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_generated_load);
+  RUN_TEST(test_recorded_trace);
+  return UNITY_END();
+}